@@ -0,0 +1,224 @@
+#include "assembler.h"
+
+void buildReferenceGraph(referenceGraph* graph, lineStream* lines);
+bool fallsThrough(referenceGraph* graph, lineStream* lines, int region);
+void freeReferenceGraph(referenceGraph* graph);
+void markReachable(referenceGraph* graph, lineStream* lines, int entryRegion);
+void stripUnreachable(referenceGraph* graph, assembly* state);
+
+// Reports the labels no operand names and the regions the END entry point cannot reach, through
+// operand references or by falling through from the region before
+// With strip, the unreachable regions are dropped from the line stream and the addresses and the
+// Symbol Table are recomputed, so Pass 2 writes a smaller image
+void analyzeReferences(char* filename, assembly* state, bool strip)
+{
+	lineStream* lines = &state->lines;
+	referenceGraph graph;
+	int entryRegion = 0, unreachableBytes = 0, unreachableCount = 0, totalBytes = 0;
+
+	buildReferenceGraph(&graph, lines);
+	for (int x = 0; x < lines->count; x++)
+	{
+		totalBytes += graph.sizes[x];
+		if (isEndDirective(getDirectiveType(lines->lines[x].operationId)) && lines->lines[x].symbolId != NO_NAME &&
+			graph.labelRegions[lines->lines[x].symbolId] >= 0)
+		{
+			entryRegion = graph.labelRegions[lines->lines[x].symbolId];
+		}
+	}
+	markReachable(&graph, lines, entryRegion);
+
+	printf("Reference analysis of %s:\n", filename);
+	for (int region = 0; region < graph.regionCount; region++)
+	{
+		sourceLine* line = &lines->lines[graph.firstLines[region]];
+		int bytes = 0;
+		bool code = false;
+
+		for (int x = graph.firstLines[region]; x < graph.firstLines[region + 1]; x++)
+		{
+			bytes += graph.sizes[x];
+			code |= getDirectiveType(lines->lines[x].operationId) == 0;
+		}
+
+		if (region > 0 && line->labelId != NO_NAME && graph.referenceCounts[line->labelId] == 0 && region != entryRegion)
+		{
+			printf("  Unreferenced label %s at %s:%d\n", getName(line->labelId), getName(line->fileId), line->lineNumber);
+		}
+		if (!graph.reachable[region])
+		{
+			printf("  Unreachable %s %s at %s:%d (%d bytes)\n", code ? "routine" : "data", getName(line->labelId),
+				getName(line->fileId), line->lineNumber, bytes);
+			unreachableBytes += bytes;
+			unreachableCount++;
+		}
+	}
+	printf("  %d of %d regions (%d of %d bytes) are unreachable from the entry point.\n",
+		unreachableCount, graph.regionCount, unreachableBytes, totalBytes);
+
+	if (strip && unreachableCount > 0)
+	{
+		stripUnreachable(&graph, state);
+		printf("  Stripped %d bytes; the program is now %d bytes.\n", unreachableBytes, state->addresses.current - state->addresses.start);
+	}
+	freeReferenceGraph(&graph);
+}
+
+// Splits the line stream into regions at each label and counts the operands that name each ID
+void buildReferenceGraph(referenceGraph* graph, lineStream* lines)
+{
+	memset(graph, 0, sizeof(referenceGraph));
+	for (int x = 0; x < lines->count; x++)
+	{
+		sourceLine* line = &lines->lines[x];
+		graph->idCount = line->labelId >= graph->idCount ? line->labelId + 1 : graph->idCount;
+		graph->idCount = line->symbolId >= graph->idCount ? line->symbolId + 1 : graph->idCount;
+	}
+
+	graph->firstLines = (int*)malloc(sizeof(int) * (lines->count + 2));
+	graph->labelRegions = (int*)malloc(sizeof(int) * (graph->idCount + 1));
+	graph->referenceCounts = (int*)calloc(graph->idCount + 1, sizeof(int));
+	graph->reachable = (bool*)calloc(lines->count + 1, sizeof(bool));
+	graph->sizes = (int*)malloc(sizeof(int) * (lines->count + 1));
+	for (int x = 0; x < graph->idCount; x++)
+	{
+		graph->labelRegions[x] = -1;
+	}
+
+	graph->firstLines[graph->regionCount++] = 0;
+	for (int x = 0; x < lines->count; x++)
+	{
+		sourceLine* line = &lines->lines[x];
+		int directiveType = getDirectiveType(line->operationId);
+
+		graph->sizes[x] = directiveType ? getMemoryAmount(directiveType, line->segments.operand) : getOpcodeFormatById(line->operationId);
+
+		// The label of START names the program rather than a region
+		if (line->labelId != NO_NAME && !isStartDirective(directiveType))
+		{
+			if (x > 0)
+			{
+				graph->firstLines[graph->regionCount++] = x;
+			}
+			graph->labelRegions[line->labelId] = graph->regionCount - 1;
+		}
+		if (line->symbolId != NO_NAME && !isEndDirective(directiveType))
+		{
+			graph->referenceCounts[line->symbolId]++;
+		}
+	}
+	graph->firstLines[graph->regionCount] = lines->count;
+}
+
+// Returns true if execution can run off the end of the region into the next one; otherwise, false
+// The last line that takes up memory decides: data and J or RSUB end the flow, other instructions do not
+bool fallsThrough(referenceGraph* graph, lineStream* lines, int region)
+{
+	char* operation;
+
+	for (int x = graph->firstLines[region + 1] - 1; x >= graph->firstLines[region]; x--)
+	{
+		sourceLine* line = &lines->lines[x];
+		if (graph->sizes[x] == 0)
+		{
+			continue;
+		}
+		if (getDirectiveType(line->operationId))
+		{
+			return false;
+		}
+		operation = line->segments.operation + (line->segments.operation[0] == '+');
+		return strcmp(operation, "J") != 0 && strcmp(operation, "RSUB") != 0;
+	}
+	return true;
+}
+
+// Releases the arrays of the reference graph
+void freeReferenceGraph(referenceGraph* graph)
+{
+	free(graph->firstLines);
+	free(graph->labelRegions);
+	free(graph->referenceCounts);
+	free(graph->reachable);
+	free(graph->sizes);
+}
+
+// Marks every region reachable from the entry region through operand references and fall-through
+// Region 0 holds START and whatever follows it up to the first label, so it is always kept
+void markReachable(referenceGraph* graph, lineStream* lines, int entryRegion)
+{
+	int* pending = (int*)malloc(sizeof(int) * (graph->regionCount + 2));
+	int pendingCount = 0;
+
+	graph->reachable[0] = true;
+	pending[pendingCount++] = 0;
+	if (!graph->reachable[entryRegion])
+	{
+		graph->reachable[entryRegion] = true;
+		pending[pendingCount++] = entryRegion;
+	}
+	while (pendingCount > 0)
+	{
+		int region = pending[--pendingCount];
+
+		for (int x = graph->firstLines[region]; x < graph->firstLines[region + 1]; x++)
+		{
+			int symbolId = lines->lines[x].symbolId;
+			int target = symbolId == NO_NAME ? -1 : graph->labelRegions[symbolId];
+
+			if (target >= 0 && !graph->reachable[target] && !isEndDirective(getDirectiveType(lines->lines[x].operationId)))
+			{
+				graph->reachable[target] = true;
+				pending[pendingCount++] = target;
+			}
+		}
+		if (region + 1 < graph->regionCount && !graph->reachable[region + 1] && fallsThrough(graph, lines, region))
+		{
+			graph->reachable[region + 1] = true;
+			pending[pendingCount++] = region + 1;
+		}
+	}
+	free(pending);
+}
+
+// Drops the lines of the unreachable regions, keeping the END line, then assigns the addresses again and
+// rebuilds the Symbol Table from the labels that are left
+void stripUnreachable(referenceGraph* graph, assembly* state)
+{
+	lineStream* lines = &state->lines;
+	address* addresses = &state->addresses;
+	int kept = 0;
+
+	for (int region = 0; region < graph->regionCount; region++)
+	{
+		for (int x = graph->firstLines[region]; x < graph->firstLines[region + 1]; x++)
+		{
+			if (graph->reachable[region] || isEndDirective(getDirectiveType(lines->lines[x].operationId)))
+			{
+				graph->sizes[kept] = graph->sizes[x];
+				lines->lines[kept++] = lines->lines[x];
+			}
+		}
+	}
+	lines->count = kept;
+
+	freeSymbolTable(&state->symbols);
+
+	addresses->current = addresses->start;
+	for (int x = 0; x < lines->count; x++)
+	{
+		sourceLine* line = &lines->lines[x];
+		int directiveType = getDirectiveType(line->operationId);
+
+		if (isStartDirective(directiveType))
+		{
+			addresses->start = addresses->current = strtol(line->segments.operand, NULL, 16);
+		}
+		else if (line->labelId != NO_NAME)
+		{
+			insertSymbol(&state->symbols, line->labelId, addresses->current);
+		}
+		line->address = addresses->current;
+		addresses->current += graph->sizes[x];
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+// Used to store the labelled regions of a program and which of them the entry point reaches
+// A region starts at a labelled line and runs to the next one; the lines before the first label form region 0
+typedef struct referenceGraph {
+	int* firstLines;         // First line of each region, followed by the line count
+	int regionCount;
+	int* labelRegions;       // Region each label ID starts; -1 for IDs that start no region
+	int* referenceCounts;    // Operands that name each ID, counted over the whole program
+	int idCount;             // One more than the largest ID of the program
+	bool* reachable;
+	int* sizes;              // Bytes of each line
+} referenceGraph;
+
+void analyzeReferences(char* filename, assembly* state, bool strip);
@@ -0,0 +1,123 @@
+#pragma once
+
+// Every module includes this header: the project headers and their structures come first, then the
+// headers and structures of the modules added to the assembler since
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "headers.h"
+
+#define COMMENT 35
+#define ERROR_MESSAGE_SIZE 256
+#define INPUT_BUF_SIZE 60
+
+#include "asyncio.h"
+#include "intern.h"
+#include "records.h"
+#include "spill.h"
+
+// Errors added to the assembler since the project errors; they are numbered after those in errors.h, so the
+// codes of the project errors keep their values
+enum assemblerErrors {
+	CONFLICTING_OPTIONS = UNKNOWN_SYMBOL + 1, // Options that cannot be combined were given together
+	ILLEGAL_CONDITION,   // Malformed IF/ELSE/ENDIF
+	ILLEGAL_FILE_FORMAT, // A binary input file is malformed
+	ILLEGAL_INCLUDE,     // INCLUDE of a missing, recursive or misplaced file
+	ILLEGAL_MACRO,       // Malformed macro definition or expansion
+	MACRO_ARGUMENT_COUNT,
+	MEMORY_LIMIT,        // A bounded-memory assembly does not fit --max-memory
+	WRITE_FAILED         // An output file written by asynchronous I/O could not be written
+};
+
+// Used to capture an error as a diagnostic instead of displaying it
+typedef struct errorReport {
+	int errorType;
+	char* filename;              // Location of the source line being assembled; NULL when there is none
+	int lineNumber;
+	char message[ERROR_MESSAGE_SIZE];
+} errorReport;
+
+// Error location, recovery and capture; defined in errors.c
+void setErrorCapture(errorReport* capture);
+void setErrorLocation(char* filename, int lineNumber);
+void setErrorRecovery(jmp_buf* recovery);
+
+// Lookups of directives and opcodes, mostly by interned name ID; defined in directives.c and opcodes.c
+int getDirectiveType(int nameId);
+int getOpcodeFormatById(int nameId);
+int getOpcodeValueById(int nameId);
+void internDirectives(void);
+void internOpcodes(void);
+bool isIllegalFormat4(char* operation);
+
+// Used to store the command-line options that select optional assembler behavior
+typedef struct options {
+	bool optimize;    // Choose the smallest valid Format 3/4 encoding for each instruction
+	int listingMode;  // LISTING_TEXT, LISTING_NONE or LISTING_SIDECAR
+	bool render;      // Render the .lst from the .lsx sidecar instead of assembling
+	bool debugInfo;   // Write the .dbg address/symbol/line index
+	bool symbols;     // Print the Symbol Table in address order
+	bool watch;       // Reassemble whenever the source changes
+	bool disassemble; // Disassemble a .obj file or memory image instead of assembling
+	bool load;        // Load a .obj file into a memory image instead of assembling
+	bool translate;   // Translate a .obj file into a C program instead of assembling
+	int packLimit;    // Maximum bytes in a packed Text record; 0 for standard records
+	bool pipeline;    // Lex, encode, format and write on separate threads
+	long maxMemory;   // Bytes a bounded-memory assembly may use; 0 to keep the line stream in memory
+	bool bench;       // Time the hot functions on the tokens of the source instead of assembling
+	bool benchJson;   // Also write the timings to a .bench.json file
+	char* delta;      // Previous .obj file or memory image to write a delta object against; NULL for none
+	bool analyze;     // Report unreferenced labels and regions the entry point cannot reach
+	bool stripUnused; // Also drop the unreachable regions before Pass 2
+	char* cacheDir;   // Directory of the output cache; NULL to always assemble
+	long cacheSize;   // Bytes the output cache may hold before the least recently used entries are evicted
+	bool asyncIO;     // Read the input files ahead and write the output files behind the assembly
+	bool check;       // Report the errors of Pass 1 and operand resolution as JSON diagnostics instead of assembling
+} options;
+
+// Modules that depend on the structures above
+#include "macros.h"
+#include "source.h"
+#include "pipeline.h"
+#include "listing.h"
+#include "debuginfo.h"
+#include "loader.h"
+#include "disassembler.h"
+#include "translator.h"
+#include "encoder.h"
+#include "watch.h"
+#include "check.h"
+
+// Used to keep the results of an assembly resident between watch mode rebuilds
+typedef struct assembly {
+	symbolTable symbols;
+	lineStream lines;
+	address addresses;
+	int* encodings;   // Format 3/4 object code of each line of the line stream
+} assembly;
+
+// Used to carry the output files of Pass 2 from one range of lines to the next
+typedef struct pass2Output {
+	options* settings;
+	pipeline* stages;
+	char* lstName;
+	char* objName;
+	char* lstTemp;    // Names the files are written under until watch mode renames them into place
+	char* objTemp;
+	FILE* obj;
+	listing lst;
+	objectFileData hdr;
+	objectFileData txt;
+	recordPacker packer;
+	int execAddr;
+	int rsubId;
+	bool started;     // The first START has set the Header record
+} pass2Output;
+
+// Modules that depend on the assembly
+#include "analysis.h"
+#include "bench.h"
+#include "cache.h"
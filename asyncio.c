@@ -0,0 +1,695 @@
+#define _GNU_SOURCE
+#include "assembler.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+int closeBufferedOutput(void* cookie);
+void completeRequest(asyncIO* io, ioRequest* request, int result, bool statx);
+void flushAsyncWrites(void);
+void freeRequest(ioRequest* request);
+void performRequest(ioRequest* request);
+struct io_uring_sqe* queueEntry(uringQueue* queue, int opcode, ioRequest* request, int tag);
+void reapCompletions(asyncIO* io, bool wait);
+void* runWorker(void* argument);
+int seekBufferedOutput(void* cookie, off64_t* offset, int whence);
+bool setupUring(uringQueue* queue);
+void startRequest(asyncIO* io, ioRequest* request);
+void submitEntries(uringQueue* queue, bool wait);
+void sweepWrites(asyncIO* io);
+void transferNext(asyncIO* io, ioRequest* request);
+void waitForRequest(asyncIO* io, ioRequest* request);
+ssize_t writeBufferedOutput(void* cookie, const char* buffer, size_t size);
+
+// Asynchronous I/O of the batch being assembled; NULL when files are read and written directly
+asyncIO* activeIO = NULL;
+
+// Starts the reads of the input files up to ASYNC_IO_PREFETCH files ahead of the one about to be
+// assembled, and moves the requests in flight along without waiting for them
+// Reads of earlier files that were never claimed, for example because of a cache hit, are dropped
+void advanceAsyncIO(int fileIndex)
+{
+	asyncIO* io = activeIO;
+
+	if (io == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&io->lock);
+	for (int x = 0; x < fileIndex && x < io->fileCount; x++)
+	{
+		if (io->reads[x] != NULL)
+		{
+			waitForRequest(io, io->reads[x]);
+			freeRequest(io->reads[x]);
+			io->reads[x] = NULL;
+		}
+	}
+	for (io->nextRead = io->nextRead > fileIndex ? io->nextRead : fileIndex;
+		io->nextRead < io->fileCount && io->nextRead <= fileIndex + ASYNC_IO_PREFETCH; io->nextRead++)
+	{
+		ioRequest* request = (ioRequest*)calloc(1, sizeof(ioRequest));
+		request->path = io->filenames[io->nextRead];
+		request->descriptor = -1;
+		io->reads[io->nextRead] = request;
+		startRequest(io, request);
+	}
+	if (io->uring)
+	{
+		reapCompletions(io, false);
+	}
+	sweepWrites(io);
+	pthread_mutex_unlock(&io->lock);
+}
+
+// Waits until every output file handed to asynchronous I/O is written and closed, so it can be read again
+void awaitAsyncWrites(void)
+{
+	asyncIO* io = activeIO;
+
+	if (io == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&io->lock);
+	for (int x = 0; x < io->writeCount; x++)
+	{
+		waitForRequest(io, io->writes[x]);
+	}
+	sweepWrites(io);
+	pthread_mutex_unlock(&io->lock);
+}
+
+// Takes the bytes of an input file read ahead by asynchronous I/O, waiting for the read if it is still in flight
+// The caller owns the returned buffer, which ends with '\0'
+// Returns the bytes; otherwise, NULL (the file was not read ahead or could not be read)
+char* claimPrefetchedFile(char* filename, size_t* size)
+{
+	asyncIO* io = activeIO;
+	char* data = NULL;
+
+	if (io == NULL)
+	{
+		return NULL;
+	}
+	pthread_mutex_lock(&io->lock);
+	for (int x = 0; x < io->fileCount; x++)
+	{
+		ioRequest* request = io->reads[x];
+		if (request == NULL || strcmp(request->path, filename) != 0)
+		{
+			continue;
+		}
+
+		waitForRequest(io, request);
+		if (request->error == 0)
+		{
+			data = request->data;
+			*size = request->size;
+			request->data = NULL;
+			io->prefetched++;
+		}
+		freeRequest(request);
+		io->reads[x] = NULL;
+		break;
+	}
+	pthread_mutex_unlock(&io->lock);
+	return data;
+}
+
+// Hands a closed output file to asynchronous I/O, which writes it behind the assembly
+// At most ASYNC_IO_QUEUE_SIZE files wait to be written; beyond that, the oldest is waited for first
+int closeBufferedOutput(void* cookie)
+{
+	bufferedOutput* output = (bufferedOutput*)cookie;
+	asyncIO* io = activeIO;
+	ioRequest* request = (ioRequest*)calloc(1, sizeof(ioRequest));
+
+	request->path = output->path;
+	request->data = output->data;
+	request->size = output->size;
+	request->write = true;
+	request->descriptor = -1;
+	free(output);
+
+	pthread_mutex_lock(&io->lock);
+	if (io->writeCount == ASYNC_IO_QUEUE_SIZE)
+	{
+		waitForRequest(io, io->writes[0]);
+		sweepWrites(io);
+	}
+	if (io->writeCount == io->writeCapacity)
+	{
+		io->writeCapacity = io->writeCapacity ? io->writeCapacity * 2 : 16;
+		io->writes = (ioRequest**)realloc(io->writes, sizeof(ioRequest*) * io->writeCapacity);
+	}
+	io->writes[io->writeCount++] = request;
+	startRequest(io, request);
+	if (io->uring)
+	{
+		reapCompletions(io, false);
+	}
+	pthread_mutex_unlock(&io->lock);
+	return 0;
+}
+
+// Moves an io_uring request to its next step once a completion of its current step arrives
+// The open of a read waits for its statx as well, which gives the size of the buffer to read into
+void completeRequest(asyncIO* io, ioRequest* request, int result, bool statx)
+{
+	if (result < 0 && request->error == 0)
+	{
+		request->error = -result;
+	}
+
+	if (request->state == IO_OPENING)
+	{
+		if (!statx && result >= 0)
+		{
+			request->descriptor = result;
+		}
+		if (--request->pending > 0)
+		{
+			return;
+		}
+		if (request->descriptor < 0)
+		{
+			request->state = IO_DONE;
+			return;
+		}
+		if (!request->write && request->error == 0)
+		{
+			request->size = request->status->stx_size;
+			request->data = (char*)malloc(request->size + 1);
+		}
+		request->state = IO_TRANSFERRING;
+		transferNext(io, request);
+	}
+	else if (request->state == IO_TRANSFERRING)
+	{
+		if (result > 0)
+		{
+			request->transferred += result;
+		}
+		else if (result == 0 && request->write && request->error == 0)
+		{
+			request->error = EIO;
+		}
+		else if (result == 0)
+		{
+			// The file shrank since its statx; what was read is all there is
+			request->size = request->transferred;
+		}
+		transferNext(io, request);
+	}
+	else if (request->state == IO_CLOSING)
+	{
+		request->state = IO_DONE;
+	}
+}
+
+// Tears down asynchronous I/O once the batch is assembled: waits for the writes, drops the reads that
+// were never claimed and stops the io_uring or the worker threads
+void finishAsyncIO(void)
+{
+	asyncIO* io = activeIO;
+
+	if (io == NULL)
+	{
+		return;
+	}
+	awaitAsyncWrites();
+	advanceAsyncIO(io->fileCount);
+
+	if (io->uring)
+	{
+		munmap(io->queue.sqes, io->queue.sqeSize);
+		munmap(io->queue.ringMap, io->queue.ringSize);
+		close(io->queue.descriptor);
+	}
+	else
+	{
+		pthread_mutex_lock(&io->lock);
+		io->stopping = true;
+		pthread_cond_broadcast(&io->queued);
+		pthread_mutex_unlock(&io->lock);
+		for (int x = 0; x < ASYNC_IO_THREADS; x++)
+		{
+			pthread_join(io->workers[x], NULL);
+		}
+	}
+
+	printf("Asynchronous I/O (%s): %d input files read ahead, %d output files written behind.\n",
+		io->uring ? "io_uring" : "worker threads", io->prefetched, io->written);
+	pthread_mutex_destroy(&io->lock);
+	pthread_cond_destroy(&io->queued);
+	pthread_cond_destroy(&io->finished);
+	free(io->reads);
+	free(io->writes);
+	free(io);
+	activeIO = NULL;
+}
+
+// Writes the output files of the jobs that finished before an error ends the run, as they would be without
+// asynchronous I/O; nothing is waited for when the error was found while the requests were being handled
+void flushAsyncWrites(void)
+{
+	asyncIO* io = activeIO;
+
+	if (io == NULL || pthread_mutex_trylock(&io->lock) != 0)
+	{
+		return;
+	}
+	for (int x = 0; x < io->writeCount; x++)
+	{
+		waitForRequest(io, io->writes[x]);
+	}
+	pthread_mutex_unlock(&io->lock);
+}
+
+// Releases a request; the path of a read belongs to the list of input files
+void freeRequest(ioRequest* request)
+{
+	if (request->write)
+	{
+		free(request->path);
+	}
+	free(request->data);
+	free(request->status);
+	free(request);
+}
+
+// Opens an output file of Pass 2 in memory, to be written by asynchronous I/O once it is closed
+// Returns the file; otherwise, NULL (asynchronous I/O is not in use)
+FILE* openBufferedOutput(char* filename, char* mode)
+{
+	cookie_io_functions_t functions = { NULL, writeBufferedOutput, seekBufferedOutput, closeBufferedOutput };
+	bufferedOutput* output;
+
+	if (activeIO == NULL)
+	{
+		return NULL;
+	}
+	output = (bufferedOutput*)calloc(1, sizeof(bufferedOutput));
+	output->path = strdup(filename);
+	output->capacity = ASYNC_IO_OUTPUT_SIZE;
+	output->data = (char*)malloc(output->capacity);
+	return fopencookie(output, mode, functions);
+}
+
+// Reads or writes a whole file with blocking calls on a worker thread of the fallback
+void performRequest(ioRequest* request)
+{
+	struct stat status;
+	ssize_t count = 1;
+
+	request->descriptor = request->write ? open(request->path, O_WRONLY | O_CREAT | O_TRUNC, 0644) : open(request->path, O_RDONLY);
+	if (request->descriptor < 0)
+	{
+		request->error = errno;
+		return;
+	}
+	if (!request->write)
+	{
+		if (fstat(request->descriptor, &status) != 0)
+		{
+			request->error = errno;
+			status.st_size = 0;
+		}
+		request->size = status.st_size;
+		request->data = (char*)malloc(request->size + 1);
+	}
+
+	while (request->error == 0 && request->transferred < request->size && count > 0)
+	{
+		count = request->write ? pwrite(request->descriptor, request->data + request->transferred, request->size - request->transferred, request->transferred) :
+			pread(request->descriptor, request->data + request->transferred, request->size - request->transferred, request->transferred);
+		if (count > 0)
+		{
+			request->transferred += count;
+		}
+		else if (count < 0 || request->write)
+		{
+			request->error = count < 0 ? errno : EIO;
+		}
+	}
+	if (!request->write && request->data != NULL)
+	{
+		request->size = request->transferred;
+		request->data[request->size] = '\0';
+	}
+	if (close(request->descriptor) != 0 && request->write && request->error == 0)
+	{
+		request->error = errno;
+	}
+}
+
+// Fills the next submission queue entry for a step of a request, submitting the queue first when it is full
+// Returns the entry, whose operation-specific fields are left for the caller
+struct io_uring_sqe* queueEntry(uringQueue* queue, int opcode, ioRequest* request, int tag)
+{
+	unsigned tail = *queue->sqTail + queue->queued;
+	struct io_uring_sqe* entry;
+
+	if (tail - atomic_load_explicit((atomic_uint*)queue->sqHead, memory_order_acquire) > *queue->sqMask)
+	{
+		submitEntries(queue, false);
+		tail = *queue->sqTail;
+	}
+	entry = &queue->sqes[tail & *queue->sqMask];
+	memset(entry, 0, sizeof(struct io_uring_sqe));
+	entry->opcode = opcode;
+	entry->user_data = (uintptr_t)request | tag;
+	queue->sqArray[tail & *queue->sqMask] = tail & *queue->sqMask;
+	queue->queued++;
+	return entry;
+}
+
+// Submits the queued entries and handles every completion that has arrived
+// With wait, blocks until at least one completion arrives
+void reapCompletions(asyncIO* io, bool wait)
+{
+	uringQueue* queue = &io->queue;
+	unsigned head, tail;
+
+	submitEntries(queue, wait);
+	head = *queue->cqHead;
+	tail = atomic_load_explicit((atomic_uint*)queue->cqTail, memory_order_acquire);
+	for (; head != tail; head++)
+	{
+		struct io_uring_cqe* completion = &queue->cqes[head & *queue->cqMask];
+		ioRequest* request = (ioRequest*)(uintptr_t)(completion->user_data & ~(uint64_t)ASYNC_IO_STATX_TAG);
+
+		queue->inFlight--;
+		completeRequest(io, request, completion->res, (completion->user_data & ASYNC_IO_STATX_TAG) != 0);
+	}
+	atomic_store_explicit((atomic_uint*)queue->cqHead, head, memory_order_release);
+}
+
+// Worker thread of the fallback: performs the queued requests one at a time until the pool is stopped
+void* runWorker(void* argument)
+{
+	asyncIO* io = (asyncIO*)argument;
+	ioRequest* request;
+
+	pthread_mutex_lock(&io->lock);
+	while (true)
+	{
+		while (io->first == NULL && !io->stopping)
+		{
+			pthread_cond_wait(&io->queued, &io->lock);
+		}
+		if ((request = io->first) == NULL)
+		{
+			break;
+		}
+		io->first = request->next;
+		io->last = io->first != NULL ? io->last : NULL;
+		pthread_mutex_unlock(&io->lock);
+
+		performRequest(request);
+
+		pthread_mutex_lock(&io->lock);
+		request->state = IO_DONE;
+		pthread_cond_broadcast(&io->finished);
+	}
+	pthread_mutex_unlock(&io->lock);
+	return NULL;
+}
+
+// Moves the position of a buffered output file; a write past its end fills the gap with zero bytes
+int seekBufferedOutput(void* cookie, off64_t* offset, int whence)
+{
+	bufferedOutput* output = (bufferedOutput*)cookie;
+	off64_t position = *offset;
+
+	if (whence == SEEK_CUR)
+	{
+		position += output->position;
+	}
+	else if (whence == SEEK_END)
+	{
+		position += output->size;
+	}
+	if (position < 0)
+	{
+		return -1;
+	}
+	output->position = *offset = position;
+	return 0;
+}
+
+// Creates an io_uring and maps its rings
+// Returns true if the kernel supports every operation the requests use; otherwise, false
+bool setupUring(uringQueue* queue)
+{
+	int opcodes[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_WRITE, IORING_OP_CLOSE };
+	struct io_uring_params parameters;
+	struct io_uring_probe* probe;
+	unsigned char* ring;
+	bool supported;
+
+	memset(queue, 0, sizeof(uringQueue));
+	memset(&parameters, 0, sizeof(parameters));
+	queue->descriptor = syscall(__NR_io_uring_setup, ASYNC_IO_QUEUE_SIZE, &parameters);
+	if (queue->descriptor < 0)
+	{
+		return false;
+	}
+
+	// Kernels that can probe their operations also map both rings at once and never drop completions
+	probe = (struct io_uring_probe*)calloc(1, sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+	supported = syscall(__NR_io_uring_register, queue->descriptor, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+		(parameters.features & IORING_FEAT_SINGLE_MMAP) && (parameters.features & IORING_FEAT_NODROP);
+	for (int x = 0; supported && x < (int)(sizeof(opcodes) / sizeof(opcodes[0])); x++)
+	{
+		supported = opcodes[x] <= probe->last_op && (probe->ops[opcodes[x]].flags & IO_URING_OP_SUPPORTED);
+	}
+	free(probe);
+	if (!supported)
+	{
+		close(queue->descriptor);
+		return false;
+	}
+
+	queue->ringSize = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+	if (parameters.cq_off.cqes + parameters.cq_entries * sizeof(struct io_uring_cqe) > queue->ringSize)
+	{
+		queue->ringSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(struct io_uring_cqe);
+	}
+	queue->sqeSize = parameters.sq_entries * sizeof(struct io_uring_sqe);
+	queue->ringMap = mmap(NULL, queue->ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, queue->descriptor, IORING_OFF_SQ_RING);
+	queue->sqes = (struct io_uring_sqe*)mmap(NULL, queue->sqeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, queue->descriptor, IORING_OFF_SQES);
+	if (queue->ringMap == MAP_FAILED || queue->sqes == MAP_FAILED)
+	{
+		if (queue->ringMap != MAP_FAILED)
+		{
+			munmap(queue->ringMap, queue->ringSize);
+		}
+		close(queue->descriptor);
+		return false;
+	}
+
+	ring = (unsigned char*)queue->ringMap;
+	queue->sqHead = (unsigned*)(ring + parameters.sq_off.head);
+	queue->sqTail = (unsigned*)(ring + parameters.sq_off.tail);
+	queue->sqMask = (unsigned*)(ring + parameters.sq_off.ring_mask);
+	queue->sqArray = (unsigned*)(ring + parameters.sq_off.array);
+	queue->cqHead = (unsigned*)(ring + parameters.cq_off.head);
+	queue->cqTail = (unsigned*)(ring + parameters.cq_off.tail);
+	queue->cqMask = (unsigned*)(ring + parameters.cq_off.ring_mask);
+	queue->cqes = (struct io_uring_cqe*)(ring + parameters.cq_off.cqes);
+	return true;
+}
+
+// Starts asynchronous I/O for a batch of input files, with io_uring when the kernel supports it and a
+// pool of worker threads otherwise
+void startAsyncIO(char* filenames[], int fileCount)
+{
+	asyncIO* io = (asyncIO*)calloc(1, sizeof(asyncIO));
+
+	io->filenames = filenames;
+	io->fileCount = fileCount;
+	io->reads = (ioRequest**)calloc(fileCount, sizeof(ioRequest*));
+	pthread_mutex_init(&io->lock, NULL);
+	pthread_cond_init(&io->queued, NULL);
+	pthread_cond_init(&io->finished, NULL);
+
+	io->uring = setupUring(&io->queue);
+	for (int x = 0; !io->uring && x < ASYNC_IO_THREADS; x++)
+	{
+		pthread_create(&io->workers[x], NULL, runWorker, io);
+	}
+	activeIO = io;
+	atexit(flushAsyncWrites);
+}
+
+// Starts a request: with io_uring, its open (and the statx of a read) joins the next submission, so the
+// opens of a batch of files are submitted together; otherwise, it joins the queue of the worker threads
+void startRequest(asyncIO* io, ioRequest* request)
+{
+	struct io_uring_sqe* entry;
+
+	if (!io->uring)
+	{
+		request->state = IO_QUEUED;
+		if (io->last != NULL)
+		{
+			io->last->next = request;
+		}
+		else
+		{
+			io->first = request;
+		}
+		io->last = request;
+		pthread_cond_signal(&io->queued);
+		return;
+	}
+
+	request->state = IO_OPENING;
+	request->pending = request->write ? 1 : 2;
+	entry = queueEntry(&io->queue, IORING_OP_OPENAT, request, 0);
+	entry->fd = AT_FDCWD;
+	entry->addr = (uintptr_t)request->path;
+	entry->len = request->write ? 0644 : 0;
+	entry->open_flags = request->write ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+	if (!request->write)
+	{
+		request->status = (struct statx*)calloc(1, sizeof(struct statx));
+		entry = queueEntry(&io->queue, IORING_OP_STATX, request, ASYNC_IO_STATX_TAG);
+		entry->fd = AT_FDCWD;
+		entry->addr = (uintptr_t)request->path;
+		entry->len = STATX_SIZE;
+		entry->off = (uintptr_t)request->status;
+	}
+}
+
+// Publishes the queued entries to the kernel and submits every entry it has not consumed yet
+// With wait, also blocks until at least one completion arrives
+void submitEntries(uringQueue* queue, bool wait)
+{
+	unsigned tail = *queue->sqTail + queue->queued;
+	unsigned waiting;
+
+	queue->inFlight += queue->queued;
+	queue->queued = 0;
+	atomic_store_explicit((atomic_uint*)queue->sqTail, tail, memory_order_release);
+	waiting = tail - atomic_load_explicit((atomic_uint*)queue->sqHead, memory_order_acquire);
+	if (waiting == 0 && (!wait || queue->inFlight == 0))
+	{
+		return;
+	}
+	while (syscall(__NR_io_uring_enter, queue->descriptor, waiting, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0) < 0)
+	{
+		// Completions the kernel could not post yet are made room for by the caller reaping
+		if (errno == EBUSY)
+		{
+			return;
+		}
+		if (errno != EINTR && errno != EAGAIN)
+		{
+			displayError(FILE_NOT_FOUND, "io_uring");
+			exit(-1);
+		}
+	}
+}
+
+// Releases the output files that have been written, reporting the first that could not be
+// Called with the lock held, which is released before the error ends the run so the exit handler can still
+// write the other output files
+void sweepWrites(asyncIO* io)
+{
+	char reason[ERROR_MESSAGE_SIZE];
+	int kept = 0;
+
+	for (int x = 0; x < io->writeCount; x++)
+	{
+		ioRequest* request = io->writes[x];
+		if (request->state != IO_DONE)
+		{
+			io->writes[kept++] = request;
+			continue;
+		}
+		if (request->error != 0)
+		{
+			snprintf(reason, sizeof(reason), "%s: %s", request->path, strerror(request->error));
+			pthread_mutex_unlock(&io->lock);
+			displayError(WRITE_FAILED, reason);
+			exit(-1);
+		}
+		freeRequest(request);
+		io->written++;
+	}
+	io->writeCount = kept;
+}
+
+// Queues the read or write of the rest of a file, or its close once every byte has been transferred
+void transferNext(asyncIO* io, ioRequest* request)
+{
+	struct io_uring_sqe* entry;
+
+	if (request->error == 0 && request->transferred < request->size)
+	{
+		entry = queueEntry(&io->queue, request->write ? IORING_OP_WRITE : IORING_OP_READ, request, 0);
+		entry->fd = request->descriptor;
+		entry->addr = (uintptr_t)(request->data + request->transferred);
+		entry->len = request->size - request->transferred;
+		entry->off = request->transferred;
+		return;
+	}
+
+	if (!request->write && request->data != NULL)
+	{
+		request->size = request->transferred;
+		request->data[request->size] = '\0';
+	}
+	request->state = IO_CLOSING;
+	entry = queueEntry(&io->queue, IORING_OP_CLOSE, request, 0);
+	entry->fd = request->descriptor;
+}
+
+// Waits until a request is done; with io_uring, the waiting thread submits and reaps for every request
+void waitForRequest(asyncIO* io, ioRequest* request)
+{
+	while (request->state != IO_DONE)
+	{
+		if (io->uring)
+		{
+			reapCompletions(io, true);
+		}
+		else
+		{
+			pthread_cond_wait(&io->finished, &io->lock);
+		}
+	}
+}
+
+// Copies formatted output into the memory of a buffered output file at its position
+// Returns the number of bytes accepted, which is always all of them
+ssize_t writeBufferedOutput(void* cookie, const char* buffer, size_t size)
+{
+	bufferedOutput* output = (bufferedOutput*)cookie;
+	size_t end = output->position + size;
+
+	if (end > output->capacity)
+	{
+		while (end > output->capacity)
+		{
+			output->capacity *= 2;
+		}
+		output->data = (char*)realloc(output->data, output->capacity);
+	}
+	if ((size_t)output->position > output->size)
+	{
+		memset(output->data + output->size, 0, output->position - output->size);
+	}
+	memcpy(output->data + output->position, buffer, size);
+	output->position = end;
+	output->size = end > output->size ? end : output->size;
+	return size;
+}
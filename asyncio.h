@@ -0,0 +1,84 @@
+#pragma once
+
+#define ASYNC_IO_OUTPUT_SIZE 4096    // Initial capacity of an output file held in memory until it is written
+#define ASYNC_IO_PREFETCH 8          // Input files read ahead of the one being assembled
+#define ASYNC_IO_QUEUE_SIZE 64       // Submission queue entries of the io_uring; also the most requests in flight
+#define ASYNC_IO_STATX_TAG 1         // Marks the user data of the statx that runs beside the open of a read
+#define ASYNC_IO_THREADS 4           // Worker threads of the fallback when io_uring is not available
+
+// States of a whole-file request
+enum ioStates { IO_QUEUED, IO_OPENING, IO_TRANSFERRING, IO_CLOSING, IO_DONE };
+
+// Used to read or write a whole file through its open, transfer and close
+// With io_uring, each step is a submission queue entry and the requests of a batch advance together
+typedef struct ioRequest {
+	char* path;
+	char* data;                  // Bytes read, ending with '\0', or bytes to write
+	size_t size;
+	size_t transferred;
+	bool write;
+	int state;                   // IO_QUEUED to IO_DONE
+	int descriptor;
+	int pending;                 // Completions the current state still waits for
+	int error;                   // errno of the first failed step; 0 on success
+	struct statx* status;        // Size of a file being read
+	struct ioRequest* next;      // Next request of the fallback queue
+} ioRequest;
+
+// Used to share the submission and completion rings of an io_uring with the kernel
+typedef struct uringQueue {
+	int descriptor;
+	unsigned* sqHead;
+	unsigned* sqTail;
+	unsigned* sqMask;
+	unsigned* sqArray;
+	struct io_uring_sqe* sqes;
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned* cqMask;
+	struct io_uring_cqe* cqes;
+	void* ringMap;
+	size_t ringSize;
+	size_t sqeSize;
+	unsigned queued;             // Entries filled since the last submission
+	int inFlight;                // Entries submitted whose completion has not been reaped
+} uringQueue;
+
+// Used to read the input files of a batch ahead of their assembly and to write the output files behind it
+// Without io_uring, a pool of worker threads performs the same requests with blocking calls
+typedef struct asyncIO {
+	bool uring;
+	uringQueue queue;
+	pthread_t workers[ASYNC_IO_THREADS];
+	pthread_mutex_t lock;
+	pthread_cond_t queued;       // A request was added to the fallback queue, or the pool is stopping
+	pthread_cond_t finished;     // A request reached IO_DONE
+	ioRequest* first;            // Fallback queue of requests no worker has taken
+	ioRequest* last;
+	bool stopping;
+	char** filenames;            // Input files of the batch, in order
+	ioRequest** reads;           // Read of each input file; NULL until it is started or once it is claimed
+	int fileCount;
+	int nextRead;                // First input file whose read has not been started
+	ioRequest** writes;          // Writes not yet known to be done
+	int writeCount;
+	int writeCapacity;
+	int prefetched;              // Input files handed to the assembler from memory
+	int written;                 // Output files written behind the assembly
+} asyncIO;
+
+// Used to hold an output file of Pass 2 in memory until it is closed and handed to asyncIO
+typedef struct bufferedOutput {
+	char* path;
+	char* data;
+	size_t size;
+	size_t capacity;
+	off_t position;
+} bufferedOutput;
+
+void advanceAsyncIO(int fileIndex);
+void awaitAsyncWrites(void);
+char* claimPrefetchedFile(char* filename, size_t* size);
+void finishAsyncIO(void);
+FILE* openBufferedOutput(char* filename, char* mode);
+void startAsyncIO(char* filenames[], int fileCount);
@@ -0,0 +1,424 @@
+#include "assembler.h"
+
+// Runs one benchmark over the corpus the provided number of times
+// Returns the nanoseconds spent in the measured function and stores the number of calls made
+typedef long (*benchFunction)(benchCorpus* corpus, int rounds, long* operations);
+
+// Used to name a benchmark in the results
+typedef struct benchEntry {
+	char* name;
+	benchFunction run;
+} benchEntry;
+
+// Hot functions that are internal to their modules
+int computeFlagsAndAddress(symbolTable* symbols, address* addresses, sourceLine* line, int format);
+int computeHash(int symbolId);
+void performPass1(symbolTable* symbols, char* filename, address* addresses, lineStream* lines, pipeline* stages, spillFile* spill);
+int searchOpcodes(char* opcode);
+void writeToObjFile(FILE* file, objectFileData data);
+
+long benchComputeFlagsAndAddress(benchCorpus* corpus, int rounds, long* operations);
+long benchComputeHash(benchCorpus* corpus, int rounds, long* operations);
+long benchGetSymbolAddress(benchCorpus* corpus, int rounds, long* operations);
+long benchInsertSymbol(benchCorpus* corpus, int rounds, long* operations);
+long benchPrepareSegments(benchCorpus* corpus, int rounds, long* operations);
+long benchSearchOpcodes(benchCorpus* corpus, int rounds, long* operations);
+long benchWriteToObjFile(benchCorpus* corpus, int rounds, long* operations);
+void buildCorpus(benchCorpus* corpus, char* filename);
+void buildRecords(benchCorpus* corpus);
+double computeSquareRoot(double value);
+long elapsedNanoseconds(struct timespec* start);
+void freeCorpus(benchCorpus* corpus);
+benchResult measureBenchmark(benchCorpus* corpus, benchEntry* entry);
+void writeBenchJson(char* jsonName, char* filename, benchResult results[], int count);
+
+// Results of the measured functions are added here so the compiler cannot drop the calls
+volatile long benchSink;
+
+// The hot functions of the assembler, in the order they are reported
+benchEntry benchmarks[] = {
+	{ "searchOpcodes", benchSearchOpcodes },
+	{ "computeHash", benchComputeHash },
+	{ "insertSymbol", benchInsertSymbol },
+	{ "getSymbolAddress", benchGetSymbolAddress },
+	{ "prepareSegments", benchPrepareSegments },
+	{ "computeFlagsAndAddress", benchComputeFlagsAndAddress },
+	{ "writeToObjFile", benchWriteToObjFile },
+	{ NULL, NULL }
+};
+
+// Encodes every Format 3/4 instruction of the corpus
+long benchComputeFlagsAndAddress(benchCorpus* corpus, int rounds, long* operations)
+{
+	struct timespec start;
+	long sum = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < rounds; round++)
+	{
+		for (int x = 0; x < corpus->instructionCount; x++)
+		{
+			address* location = &corpus->locations[x];
+			sum += computeFlagsAndAddress(&corpus->state.symbols, location, &corpus->state.lines.lines[corpus->instructions[x]], location->increment);
+		}
+	}
+	benchSink += sum;
+	*operations = (long)rounds * corpus->instructionCount;
+	return elapsedNanoseconds(&start);
+}
+
+// Hashes every operand symbol of the corpus
+long benchComputeHash(benchCorpus* corpus, int rounds, long* operations)
+{
+	struct timespec start;
+	long sum = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < rounds; round++)
+	{
+		for (int x = 0; x < corpus->operandCount; x++)
+		{
+			sum += computeHash(corpus->operands[x]);
+		}
+	}
+	benchSink += sum;
+	*operations = (long)rounds * corpus->operandCount;
+	return elapsedNanoseconds(&start);
+}
+
+// Looks up the address of every operand symbol of the corpus
+long benchGetSymbolAddress(benchCorpus* corpus, int rounds, long* operations)
+{
+	struct timespec start;
+	long sum = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < rounds; round++)
+	{
+		for (int x = 0; x < corpus->operandCount; x++)
+		{
+			sum += getSymbolAddress(&corpus->state.symbols, corpus->operands[x]);
+		}
+	}
+	benchSink += sum;
+	*operations = (long)rounds * corpus->operandCount;
+	return elapsedNanoseconds(&start);
+}
+
+// Inserts every label of the corpus into an empty Symbol Table
+// Only the insertions are timed; the table is emptied between rounds
+long benchInsertSymbol(benchCorpus* corpus, int rounds, long* operations)
+{
+	symbolTable table;
+	long elapsed = 0;
+
+	initializeSymbolTable(&table);
+	for (int round = 0; round < rounds; round++)
+	{
+		struct timespec start;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (int x = 0; x < corpus->labelCount; x++)
+		{
+			sourceLine* line = &corpus->state.lines.lines[corpus->labels[x]];
+			insertSymbol(&table, line->labelId, line->address);
+		}
+		elapsed += elapsedNanoseconds(&start);
+
+		freeSymbolTable(&table);
+	}
+	*operations = (long)rounds * corpus->labelCount;
+	return elapsed;
+}
+
+// Separates every line of the corpus into trimmed segments
+long benchPrepareSegments(benchCorpus* corpus, int rounds, long* operations)
+{
+	struct timespec start;
+	long sum = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < rounds; round++)
+	{
+		for (int x = 0; x < corpus->state.lines.count; x++)
+		{
+			segment* segments = prepareSegments(corpus->statements[x]);
+			sum += segments->operand[0];
+			free(segments);
+		}
+	}
+	benchSink += sum;
+	*operations = (long)rounds * corpus->state.lines.count;
+	return elapsedNanoseconds(&start);
+}
+
+// Searches the opcodes array for every operation of the corpus
+long benchSearchOpcodes(benchCorpus* corpus, int rounds, long* operations)
+{
+	struct timespec start;
+	long sum = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < rounds; round++)
+	{
+		for (int x = 0; x < corpus->mnemonicCount; x++)
+		{
+			sum += searchOpcodes(corpus->mnemonics[x]);
+		}
+	}
+	benchSink += sum;
+	*operations = (long)rounds * corpus->mnemonicCount;
+	return elapsedNanoseconds(&start);
+}
+
+// Formats the object file records of the corpus into a file that discards them
+long benchWriteToObjFile(benchCorpus* corpus, int rounds, long* operations)
+{
+	FILE* file = fopen("/dev/null", "w");
+	struct timespec start;
+	long elapsed;
+
+	if (file == NULL)
+	{
+		displayError(FILE_NOT_FOUND, "/dev/null");
+		exit(-1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int round = 0; round < rounds; round++)
+	{
+		for (int x = 0; x < corpus->recordCount; x++)
+		{
+			writeToObjFile(file, corpus->records[x]);
+		}
+	}
+	elapsed = elapsedNanoseconds(&start);
+	fclose(file);
+	*operations = (long)rounds * corpus->recordCount;
+	return elapsed;
+}
+
+// Runs Pass 1 over the source file and collects the tokens each benchmark is run on
+void buildCorpus(benchCorpus* corpus, char* filename)
+{
+	lineStream* lines = &corpus->state.lines;
+	int rsubId = internName("RSUB");
+	int base = 0;
+
+	memset(corpus, 0, sizeof(benchCorpus));
+	performPass1(&corpus->state.symbols, filename, &corpus->state.addresses, lines, NULL, NULL);
+
+	corpus->statements = (char**)malloc(sizeof(char*) * lines->count);
+	corpus->mnemonics = (char**)malloc(sizeof(char*) * lines->count);
+	corpus->labels = (int*)malloc(sizeof(int) * lines->count);
+	corpus->operands = (int*)malloc(sizeof(int) * lines->count);
+	corpus->instructions = (int*)malloc(sizeof(int) * lines->count);
+	corpus->locations = (address*)malloc(sizeof(address) * lines->count);
+
+	for (int x = 0; x < lines->count; x++)
+	{
+		sourceLine* line = &lines->lines[x];
+		segment* segments = &line->segments;
+		int directiveType = getDirectiveType(line->operationId);
+		int format = directiveType ? 0 : getOpcodeFormatById(line->operationId);
+
+		corpus->statements[x] = (char*)malloc(SEGMENT_SIZE * 3);
+		sprintf(corpus->statements[x], "%-*s%-*s%s", SEGMENT_SIZE - 1, segments->label, SEGMENT_SIZE - 1, segments->operation, segments->operand);
+
+		if (segments->operation[0] != '\0')
+		{
+			corpus->mnemonics[corpus->mnemonicCount++] = segments->operation + (segments->operation[0] == '+');
+		}
+		if (segments->label[0] != '\0' && !isStartDirective(directiveType))
+		{
+			corpus->labels[corpus->labelCount++] = x;
+		}
+		if (findSymbol(&corpus->state.symbols, line->symbolId) != NULL)
+		{
+			corpus->operands[corpus->operandCount++] = line->symbolId;
+		}
+
+		if (isBaseDirective(directiveType))
+		{
+			base = getSymbolAddress(&corpus->state.symbols, line->symbolId);
+		}
+		else if ((format == FORMAT_3 || format == FORMAT_4) && line->operationId != rsubId)
+		{
+			corpus->instructions[corpus->instructionCount] = x;
+			corpus->locations[corpus->instructionCount++] = (address){ corpus->state.addresses.start, line->address, format, base };
+		}
+	}
+	buildRecords(corpus);
+}
+
+// Encodes the instructions of the corpus into Text records, with a Header record before them and an
+// End record after them
+void buildRecords(benchCorpus* corpus)
+{
+	objectFileData* record = NULL;
+	lineStream* lines = &corpus->state.lines;
+
+	corpus->records = (objectFileData*)calloc(corpus->instructionCount + 2, sizeof(objectFileData));
+	corpus->records[0].recordType = 'H';
+	corpus->records[0].startAddress = corpus->state.addresses.start;
+	corpus->records[0].programSize = corpus->state.addresses.current - corpus->state.addresses.start;
+	if (lines->count > 0)
+	{
+		sprintf(corpus->records[0].programName, "%.*s", NAME_SIZE - 1, lines->lines[0].segments.label);
+	}
+	corpus->recordCount = 1;
+
+	for (int x = 0; x < corpus->instructionCount; x++)
+	{
+		address* location = &corpus->locations[x];
+		int code = computeFlagsAndAddress(&corpus->state.symbols, location, &lines->lines[corpus->instructions[x]], location->increment);
+
+		if (record == NULL || record->recordByteCount + location->increment > BENCH_RECORD_BYTES)
+		{
+			record = &corpus->records[corpus->recordCount++];
+			record->recordType = 'T';
+			record->recordAddress = location->current;
+		}
+		record->recordEntries[record->recordEntryCount++] = (recordEntry){ location->increment, code };
+		record->recordByteCount += location->increment;
+	}
+
+	corpus->records[corpus->recordCount].recordType = 'E';
+	corpus->records[corpus->recordCount++].startAddress = corpus->state.addresses.start;
+}
+
+// Returns the square root of a value that is not negative, by Newton's method, so the assembler needs no math library
+// The first guess is not below the root, so every step lowers it until rounding stops it from falling
+double computeSquareRoot(double value)
+{
+	double root = value > 1 ? value : 1;
+	double next = (root + value / root) / 2;
+
+	if (value <= 0)
+	{
+		return 0;
+	}
+	while (next < root)
+	{
+		root = next;
+		next = (root + value / root) / 2;
+	}
+	return root;
+}
+
+// Returns the nanoseconds since the provided start time
+long elapsedNanoseconds(struct timespec* start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1000000000L + (end.tv_nsec - start->tv_nsec);
+}
+
+// Releases the tokens, Symbol Table and line stream of the corpus
+void freeCorpus(benchCorpus* corpus)
+{
+	for (int x = 0; x < corpus->state.lines.count; x++)
+	{
+		free(corpus->statements[x]);
+	}
+	free(corpus->statements);
+	free(corpus->mnemonics);
+	free(corpus->labels);
+	free(corpus->operands);
+	free(corpus->instructions);
+	free(corpus->locations);
+	free(corpus->records);
+	freeSymbolTable(&corpus->state.symbols);
+	freeLineStream(&corpus->state.lines);
+}
+
+// Times a benchmark: the corpus is repeated until a repetition makes at least BENCH_MIN_OPERATIONS
+// calls, BENCH_WARMUP_REPETITIONS repetitions are discarded, and BENCH_REPETITIONS are measured
+benchResult measureBenchmark(benchCorpus* corpus, benchEntry* entry)
+{
+	benchResult result = { entry->name, 0, 0, 0, 0 };
+	double samples[BENCH_REPETITIONS];
+	long operations;
+	int rounds;
+
+	entry->run(corpus, 1, &operations);
+	if (operations == 0)
+	{
+		return result;
+	}
+	rounds = (BENCH_MIN_OPERATIONS + operations - 1) / operations;
+
+	for (int x = 0; x < BENCH_WARMUP_REPETITIONS; x++)
+	{
+		entry->run(corpus, rounds, &operations);
+	}
+	for (int x = 0; x < BENCH_REPETITIONS; x++)
+	{
+		samples[x] = (double)entry->run(corpus, rounds, &operations) / operations;
+		result.mean += samples[x] / BENCH_REPETITIONS;
+		result.minimum = (x == 0 || samples[x] < result.minimum) ? samples[x] : result.minimum;
+	}
+	for (int x = 0; x < BENCH_REPETITIONS; x++)
+	{
+		result.deviation += (samples[x] - result.mean) * (samples[x] - result.mean) / (BENCH_REPETITIONS - 1);
+	}
+	result.deviation = computeSquareRoot(result.deviation);
+	result.operations = operations;
+	return result;
+}
+
+// Measures the hot functions of the assembler on the tokens of the source file and prints the
+// nanoseconds per call of each; the results are also written as JSON when a name is provided
+void runBenchmarks(char* filename, char* jsonName)
+{
+	benchResult results[sizeof(benchmarks) / sizeof(benchmarks[0])];
+	benchCorpus corpus;
+	int count = 0;
+
+	buildCorpus(&corpus, filename);
+
+	printf("Benchmarks of %s (%d repetitions after %d warmup):\n", filename, BENCH_REPETITIONS, BENCH_WARMUP_REPETITIONS);
+	printf("%-24s %10s %10s %10s %10s\n", "Function", "Calls/rep", "ns/call", "Std dev", "Minimum");
+	for (benchEntry* entry = benchmarks; entry->name != NULL; entry++)
+	{
+		benchResult* result = &results[count++];
+		*result = measureBenchmark(&corpus, entry);
+		printf("%-24s %10ld %10.2f %10.2f %10.2f\n", result->name, result->operations, result->mean, result->deviation, result->minimum);
+	}
+
+	if (jsonName != NULL)
+	{
+		writeBenchJson(jsonName, filename, results, count);
+	}
+	freeCorpus(&corpus);
+}
+
+// Writes the results as a JSON object so runs of different commits can be compared
+void writeBenchJson(char* jsonName, char* filename, benchResult results[], int count)
+{
+	FILE* file = fopen(jsonName, "w");
+
+	if (file == NULL)
+	{
+		displayError(FILE_NOT_FOUND, jsonName);
+		exit(-1);
+	}
+
+	fputs("{\n  \"source\": \"", file);
+	for (char* character = filename; *character != '\0'; character++)
+	{
+		if (*character == '"' || *character == '\\')
+		{
+			fputc('\\', file);
+		}
+		fputc(*character, file);
+	}
+	fprintf(file, "\",\n  \"repetitions\": %d,\n  \"warmupRepetitions\": %d,\n  \"benchmarks\": [\n", BENCH_REPETITIONS, BENCH_WARMUP_REPETITIONS);
+	for (int x = 0; x < count; x++)
+	{
+		fprintf(file, "    { \"name\": \"%s\", \"calls\": %ld, \"meanNs\": %.3f, \"deviationNs\": %.3f, \"minimumNs\": %.3f }%s\n",
+			results[x].name, results[x].operations, results[x].mean, results[x].deviation, results[x].minimum, x + 1 < count ? "," : "");
+	}
+	fputs("  ]\n}\n", file);
+	fclose(file);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#define BENCH_MIN_OPERATIONS 100000
+#define BENCH_RECORD_BYTES 30
+#define BENCH_REPETITIONS 10
+#define BENCH_WARMUP_REPETITIONS 2
+
+// Used to hold the tokens of a source file that the benchmarks are run on
+// Every token comes from Pass 1 over the file, so the mix of mnemonics, labels and operands is the file's own
+typedef struct benchCorpus {
+	assembly state;          // Symbol Table and line stream of Pass 1
+	char** statements;       // Each line rebuilt in the fixed columns read by prepareSegments
+	char** mnemonics;        // Operations without '+', directives included
+	int mnemonicCount;
+	int* labels;             // Indexes of the lines that define a label
+	int labelCount;
+	int* operands;           // Symbol IDs of operands found in the Symbol Table
+	int operandCount;
+	int* instructions;       // Indexes of the Format 3/4 lines other than RSUB
+	address* locations;      // Location counter and BASE of each of those lines
+	int instructionCount;
+	objectFileData* records; // Text records of the encoded instructions, framed by H and E records
+	int recordCount;
+} benchCorpus;
+
+// Used to store the timings of one benchmark
+typedef struct benchResult {
+	char* name;
+	long operations;         // Operations per repetition
+	double mean;             // Nanoseconds per operation
+	double deviation;
+	double minimum;
+} benchResult;
+
+void runBenchmarks(char* filename, char* jsonName);
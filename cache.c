@@ -0,0 +1,421 @@
+#include "assembler.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CACHE_COPY_SIZE 65536
+#define FNV_64_OFFSET_BASIS 14695981039346656037ull
+#define FNV_64_PRIME 1099511628211ull
+
+int compareCacheFiles(const void* first, const void* second);
+bool computeEntryKey(char* filename, options* settings, cacheKey* key);
+unsigned long long computeSourceKey(char* filename, options* settings);
+bool copyBytes(FILE* from, FILE* to, long size);
+char* createCachePath(char* directory, unsigned long long key, const char* extension);
+void evictCacheEntries(char* directory, long limit);
+int getCachedOutputs(options* settings, const char* extensions[]);
+unsigned long long hashBytes(unsigned long long hash, const void* bytes, size_t length);
+bool hashFile(unsigned long long* hash, char* path);
+void writeDependencies(char* filename, options* settings, cacheKey* key, int assemblyId);
+
+// Creates output filenames; internal to main.c
+char* createFilename(char* filename, const char* extension);
+
+// Hash of the assembler binary, so a rebuilt assembler never reads the entries of the one before
+unsigned long long assemblerKey = 0;
+
+// Orders the files of the cache directory from least to most recently used
+int compareCacheFiles(const void* first, const void* second)
+{
+	const cacheFile* a = (const cacheFile*)first;
+	const cacheFile* b = (const cacheFile*)second;
+
+	if (a->used.tv_sec != b->used.tv_sec)
+	{
+		return a->used.tv_sec < b->used.tv_sec ? -1 : 1;
+	}
+	return a->used.tv_nsec < b->used.tv_nsec ? -1 : a->used.tv_nsec > b->used.tv_nsec;
+}
+
+// Computes the entry key from the source key and the files listed by the dependency file of the source
+// Returns true if the dependency file exists and every file it lists could be read; otherwise, false
+bool computeEntryKey(char* filename, options* settings, cacheKey* key)
+{
+	char* dependencyName = createCachePath(settings->cacheDir, key->source, ".deps");
+	FILE* dependencies = fopen(dependencyName, "r");
+	char* slash = strrchr(filename, '/');
+	int directoryLength = slash != NULL ? slash - filename + 1 : 0;
+	char entry[PATH_MAX];
+	char path[PATH_MAX * 2];
+
+	free(dependencyName);
+	key->entry = hashBytes(FNV_64_OFFSET_BASIS, &key->source, sizeof(key->source));
+	key->found = dependencies != NULL;
+	if (!key->found)
+	{
+		return false;
+	}
+
+	// Relative paths are relative to the directory of the source, so checkouts in other places share entries
+	while (key->found && fgets(entry, PATH_MAX, dependencies) != NULL)
+	{
+		entry[strcspn(entry, "\n")] = '\0';
+		if (entry[0] == '/')
+		{
+			snprintf(path, sizeof(path), "%s", entry);
+		}
+		else
+		{
+			snprintf(path, sizeof(path), "%.*s%s", directoryLength, filename, entry);
+		}
+		key->entry = hashBytes(key->entry, entry, strlen(entry) + 1);
+		key->found = hashFile(&key->entry, path);
+	}
+	fclose(dependencies);
+	return key->found;
+}
+
+// Computes the key of the assembler binary, the options that change the output files and the source bytes
+// Returns the source key; 0 if the source could not be read
+unsigned long long computeSourceKey(char* filename, options* settings)
+{
+	int outputOptions[] = { settings->optimize, settings->listingMode, settings->debugInfo, settings->packLimit,
+		settings->stripUnused };
+	unsigned long long hash;
+
+	// Without /proc, the build time stands in for the binary
+	if (assemblerKey == 0)
+	{
+		assemblerKey = FNV_64_OFFSET_BASIS;
+		if (!hashFile(&assemblerKey, "/proc/self/exe"))
+		{
+			assemblerKey = hashBytes(FNV_64_OFFSET_BASIS, __DATE__ " " __TIME__, sizeof(__DATE__ " " __TIME__));
+		}
+	}
+
+	hash = hashBytes(assemblerKey, outputOptions, sizeof(outputOptions));
+	return hashFile(&hash, filename) ? hash : 0;
+}
+
+// Copies size bytes from one file to the other
+// Returns true if every byte was copied; otherwise, false
+bool copyBytes(FILE* from, FILE* to, long size)
+{
+	char buffer[CACHE_COPY_SIZE];
+
+	while (size > 0)
+	{
+		size_t count = fread(buffer, 1, size < CACHE_COPY_SIZE ? size : CACHE_COPY_SIZE, from);
+		if (count == 0 || fwrite(buffer, 1, count, to) != count)
+		{
+			return false;
+		}
+		size -= count;
+	}
+	return true;
+}
+
+// Returns the path of a file of the cache directory named by a key
+char* createCachePath(char* directory, unsigned long long key, const char* extension)
+{
+	char* path = (char*)malloc(strlen(directory) + strlen(extension) + 18);
+
+	sprintf(path, "%s/%016llx%s", directory, key, extension);
+	return path;
+}
+
+// Removes the least recently used entries and dependency files until the cache directory holds at most limit bytes
+void evictCacheEntries(char* directory, long limit)
+{
+	DIR* cache = opendir(directory);
+	cacheFile* files = NULL;
+	int fileCount = 0, capacity = 0;
+	long total = 0;
+	struct dirent* item;
+	struct stat status;
+
+	if (cache == NULL)
+	{
+		return;
+	}
+	while ((item = readdir(cache)) != NULL)
+	{
+		char* extension = strrchr(item->d_name, '.');
+		char* path;
+
+		// Files that are still being written by another run are left alone
+		if (extension == NULL || (strcmp(extension, ".entry") != 0 && strcmp(extension, ".deps") != 0))
+		{
+			continue;
+		}
+		path = (char*)malloc(strlen(directory) + strlen(item->d_name) + 2);
+		sprintf(path, "%s/%s", directory, item->d_name);
+		if (stat(path, &status) != 0)
+		{
+			free(path);
+			continue;
+		}
+		if (fileCount == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 64;
+			files = (cacheFile*)realloc(files, sizeof(cacheFile) * capacity);
+		}
+		files[fileCount].path = path;
+		files[fileCount].used = status.st_mtim;
+		files[fileCount++].size = status.st_size;
+		total += status.st_size;
+	}
+	closedir(cache);
+
+	qsort(files, fileCount, sizeof(cacheFile), compareCacheFiles);
+	for (int x = 0; x < fileCount; x++)
+	{
+		if (total > limit && unlink(files[x].path) == 0)
+		{
+			total -= files[x].size;
+		}
+		free(files[x].path);
+	}
+	free(files);
+}
+
+// Lists the extensions of the output files the options select, the .obj file first
+// Returns the number of output files
+int getCachedOutputs(options* settings, const char* extensions[])
+{
+	int count = 0;
+
+	extensions[count++] = ".obj";
+	if (settings->listingMode == LISTING_TEXT)
+	{
+		extensions[count++] = ".lst";
+	}
+	else if (settings->listingMode == LISTING_SIDECAR)
+	{
+		extensions[count++] = ".lsx";
+	}
+	if (settings->debugInfo)
+	{
+		extensions[count++] = ".dbg";
+	}
+	return count;
+}
+
+// Continues a 64-bit FNV-1a hash with the provided bytes
+// Returns the new hash value
+unsigned long long hashBytes(unsigned long long hash, const void* bytes, size_t length)
+{
+	const unsigned char* data = (const unsigned char*)bytes;
+
+	for (size_t x = 0; x < length; x++)
+	{
+		hash = (hash ^ data[x]) * FNV_64_PRIME;
+	}
+	return hash;
+}
+
+// Continues a 64-bit FNV-1a hash with the bytes of a file
+// Returns true if the file could be read; otherwise, false
+bool hashFile(unsigned long long* hash, char* path)
+{
+	char buffer[CACHE_COPY_SIZE];
+	FILE* file = fopen(path, "rb");
+	size_t count;
+
+	if (file == NULL)
+	{
+		return false;
+	}
+	while ((count = fread(buffer, 1, CACHE_COPY_SIZE, file)) > 0)
+	{
+		*hash = hashBytes(*hash, buffer, count);
+	}
+	fclose(file);
+	return true;
+}
+
+// Hashes the bytes of the source file and of each file the assembly included
+// Each file is hashed on its own and the results are added, so the order files were first included in does not matter
+unsigned long long hashSourceFiles(char* filename, int assemblyId)
+{
+	unsigned long long hash = FNV_64_OFFSET_BASIS;
+
+	hashFile(&hash, filename);
+	for (includedFile* file = getIncludedFiles(); file != NULL; file = file->next)
+	{
+		unsigned long long fileHash = FNV_64_OFFSET_BASIS;
+
+		if (file->assemblyId == assemblyId && hashFile(&fileHash, getName(file->pathId)))
+		{
+			hash += fileHash;
+		}
+	}
+	return hash;
+}
+
+// Looks the source file up in the output cache and, on a hit, writes the stored output files in place of an assembly
+// The key is kept so storeCachedOutputs does not read the source again after a miss
+// Returns true on a hit; otherwise, false
+bool restoreCachedOutputs(char* filename, options* settings, cacheKey* key)
+{
+	const char* extensions[CACHE_MAX_OUTPUTS];
+	int outputCount = getCachedOutputs(settings, extensions);
+	char* entryName;
+	char header[PATH_MAX];
+	char extension[PATH_MAX];
+	long size;
+	FILE* entry;
+	bool restored = true;
+
+	key->source = computeSourceKey(filename, settings);
+	if (key->source == 0 || !computeEntryKey(filename, settings, key))
+	{
+		return false;
+	}
+
+	entryName = createCachePath(settings->cacheDir, key->entry, ".entry");
+	entry = fopen(entryName, "rb");
+	if (entry == NULL || fgets(header, PATH_MAX, entry) == NULL || strcmp(header, CACHE_MAGIC) != 0)
+	{
+		restored = false;
+	}
+	for (int x = 0; restored && x < outputCount; x++)
+	{
+		char* outputName;
+		FILE* output;
+
+		if (fgets(header, PATH_MAX, entry) == NULL || sscanf(header, "%s %ld", extension, &size) != 2 ||
+			strcmp(extension, extensions[x]) != 0)
+		{
+			restored = false;
+			break;
+		}
+		outputName = createFilename(filename, extensions[x]);
+		output = fopen(outputName, "wb");
+		restored = output != NULL && copyBytes(entry, output, size);
+		if (output != NULL)
+		{
+			fclose(output);
+		}
+		free(outputName);
+	}
+	if (entry != NULL)
+	{
+		fclose(entry);
+	}
+
+	// A hit makes the entry and its dependency file the most recently used
+	if (restored)
+	{
+		char* dependencyName = createCachePath(settings->cacheDir, key->source, ".deps");
+		utimensat(AT_FDCWD, entryName, NULL, 0);
+		utimensat(AT_FDCWD, dependencyName, NULL, 0);
+		free(dependencyName);
+		printf("Restored the output files of %s from the cache (%016llx).\n", filename, key->entry);
+	}
+	free(entryName);
+	return restored;
+}
+
+// Stores the output files of an assembly in the output cache, then evicts entries until the cache fits its size
+// Entries are written under a temporary name and renamed into place, so runs that share the cache never read half an entry
+void storeCachedOutputs(char* filename, options* settings, cacheKey* key, int assemblyId)
+{
+	const char* extensions[CACHE_MAX_OUTPUTS];
+	int outputCount = getCachedOutputs(settings, extensions);
+	char* entryName;
+	char* tempName;
+	FILE* entry;
+	bool stored;
+
+	if (key->source == 0 || (mkdir(settings->cacheDir, 0777) != 0 && access(settings->cacheDir, W_OK) != 0))
+	{
+		return;
+	}
+	writeDependencies(filename, settings, key, assemblyId);
+	if (!computeEntryKey(filename, settings, key))
+	{
+		return;
+	}
+
+	entryName = createCachePath(settings->cacheDir, key->entry, ".entry");
+	tempName = (char*)malloc(strlen(entryName) + 24);
+	sprintf(tempName, "%s.%d.tmp", entryName, (int)getpid());
+	entry = fopen(tempName, "wb");
+	stored = entry != NULL && fputs(CACHE_MAGIC, entry) >= 0;
+	for (int x = 0; stored && x < outputCount; x++)
+	{
+		char* outputName = createFilename(filename, extensions[x]);
+		FILE* output = fopen(outputName, "rb");
+		struct stat status;
+
+		stored = output != NULL && fstat(fileno(output), &status) == 0 &&
+			fprintf(entry, "%s %ld\n", extensions[x], (long)status.st_size) > 0 && copyBytes(output, entry, status.st_size);
+		if (output != NULL)
+		{
+			fclose(output);
+		}
+		free(outputName);
+	}
+	if (entry != NULL && fclose(entry) != 0)
+	{
+		stored = false;
+	}
+	if (!stored || rename(tempName, entryName) != 0)
+	{
+		unlink(tempName);
+	}
+	free(tempName);
+	free(entryName);
+
+	evictCacheEntries(settings->cacheDir, settings->cacheSize);
+}
+
+// Writes the list of files the assembly included to the dependency file of the source key
+// Files under the directory of the source are listed relative to it; others by their real path
+void writeDependencies(char* filename, options* settings, cacheKey* key, int assemblyId)
+{
+	char* dependencyName = createCachePath(settings->cacheDir, key->source, ".deps");
+	char* tempName = (char*)malloc(strlen(dependencyName) + 24);
+	char* slash = strrchr(filename, '/');
+	char directory[PATH_MAX];
+	char sourceDirectory[PATH_MAX];
+	FILE* dependencies;
+	size_t length;
+
+	snprintf(directory, PATH_MAX, "%.*s", slash != NULL ? (int)(slash - filename) : 1, slash != NULL ? filename : ".");
+	if (directory[0] == '\0' || realpath(directory, sourceDirectory) == NULL)
+	{
+		strcpy(sourceDirectory, "/");
+	}
+	length = strlen(sourceDirectory);
+
+	sprintf(tempName, "%s.%d.tmp", dependencyName, (int)getpid());
+	dependencies = fopen(tempName, "w");
+	if (dependencies != NULL)
+	{
+		for (includedFile* file = getIncludedFiles(); file != NULL; file = file->next)
+		{
+			char* path = getName(file->pathId);
+
+			if (file->assemblyId != assemblyId)
+			{
+				continue;
+			}
+			if (strncmp(path, sourceDirectory, length) == 0 && path[length] == '/' && length > 1)
+			{
+				path += length + 1;
+			}
+			fprintf(dependencies, "%s\n", path);
+		}
+		if (fclose(dependencies) != 0 || rename(tempName, dependencyName) != 0)
+		{
+			unlink(tempName);
+		}
+	}
+	free(tempName);
+	free(dependencyName);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#define CACHE_DEFAULT_SIZE (64L << 20)
+#define CACHE_MAGIC "SICXE-CACHE 1\n"
+#define CACHE_MAX_OUTPUTS 3
+
+// Used to name the entry of a source file in the output cache
+// The source key names the list of files the source includes; the entry key also covers their bytes, so an
+// entry is only found while every included file is unchanged
+typedef struct cacheKey {
+	unsigned long long source;   // Assembler binary, output options and source bytes
+	unsigned long long entry;    // Source key, then the path and bytes of each included file
+	bool found;                  // The list of included files exists and every file in it could be read
+} cacheKey;
+
+// Used to order the files of the cache directory from least to most recently used
+typedef struct cacheFile {
+	char* path;
+	struct timespec used;        // Modification time, which a cache hit sets to the time of the hit
+	off_t size;
+} cacheFile;
+
+unsigned long long hashSourceFiles(char* filename, int assemblyId);
+bool restoreCachedOutputs(char* filename, options* settings, cacheKey* key);
+void storeCachedOutputs(char* filename, options* settings, cacheKey* key, int assemblyId);
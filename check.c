@@ -0,0 +1,275 @@
+#include "assembler.h"
+
+void addDiagnostic(sourceCheck* check, int lineIndex);
+bool checkLabels(sourceCheck* check);
+void checkOperands(sourceCheck* check);
+int compareDiagnostics(const void* first, const void* second);
+void freeSourceCheck(sourceCheck* check);
+void lexCheckedSource(sourceCheck* check, char* filename);
+void writeDiagnostics(char* filename, sourceCheck* check);
+void writeJsonString(char* string);
+
+// Pass 1 and Pass 2 checks that --check shares with the assembly; defined in main.c
+int assignLineAddress(symbolTable* symbols, sourceLine* line, int current);
+int computeFlagsAndAddress(symbolTable* symbols, address* addresses, sourceLine* line, int format);
+int getOperandFormat(sourceLine* line, int rsubId);
+
+// Names of the errors as they appear in the code of a diagnostic
+const char* errorCodes[] = {
+	[BLANK_RECORD] = "BLANK_RECORD", [CONFLICTING_OPTIONS] = "CONFLICTING_OPTIONS", [DUPLICATE] = "DUPLICATE", [FILE_NOT_FOUND] = "FILE_NOT_FOUND",
+	[ILLEGAL_CONDITION] = "ILLEGAL_CONDITION", [ILLEGAL_FILE_FORMAT] = "ILLEGAL_FILE_FORMAT",
+	[ILLEGAL_INCLUDE] = "ILLEGAL_INCLUDE", [ILLEGAL_MACRO] = "ILLEGAL_MACRO",
+	[ILLEGAL_OPCODE_DIRECTIVE] = "ILLEGAL_OPCODE_DIRECTIVE", [ILLEGAL_SYMBOL] = "ILLEGAL_SYMBOL",
+	[MACRO_ARGUMENT_COUNT] = "MACRO_ARGUMENT_COUNT", [MEMORY_LIMIT] = "MEMORY_LIMIT",
+	[MISSING_COMMAND_LINE_ARGUMENTS] = "MISSING_COMMAND_LINE_ARGUMENTS",
+	[OUT_OF_MEMORY] = "OUT_OF_MEMORY", [OUT_OF_RANGE_BYTE] = "OUT_OF_RANGE_BYTE", [OUT_OF_RANGE_WORD] = "OUT_OF_RANGE_WORD",
+	[ADDRESS_OUT_OF_RANGE] = "ADDRESS_OUT_OF_RANGE",
+	[ILLEGAL_OPCODE_FORMAT] = "ILLEGAL_OPCODE_FORMAT", [UNKNOWN_SYMBOL] = "UNKNOWN_SYMBOL", [WRITE_FAILED] = "WRITE_FAILED"
+};
+
+// Records the captured error as a diagnostic of a line of the line stream
+// The column and length pick out the segment the error is about, so an editor can underline it
+void addDiagnostic(sourceCheck* check, int lineIndex)
+{
+	diagnostic* entry;
+	segment* segments;
+
+	if (check->count == check->capacity)
+	{
+		check->capacity = check->capacity ? check->capacity * 2 : 16;
+		check->diagnostics = (diagnostic*)realloc(check->diagnostics, sizeof(diagnostic) * check->capacity);
+	}
+	entry = &check->diagnostics[check->count++];
+	entry->errorType = check->report.errorType;
+	entry->lineIndex = lineIndex;
+	entry->filename = check->report.filename;
+	entry->lineNumber = check->report.lineNumber;
+	entry->column = CHECK_LABEL_COLUMN;
+	entry->length = 0;
+	strcpy(entry->message, check->report.message);
+
+	if (lineIndex >= check->lines.count)
+	{
+		return;
+	}
+	segments = &check->lines.lines[lineIndex].segments;
+	switch (entry->errorType)
+	{
+	case DUPLICATE:
+	case ILLEGAL_SYMBOL:
+		entry->length = strlen(segments->label);
+		break;
+	case ILLEGAL_OPCODE_DIRECTIVE:
+	case ILLEGAL_OPCODE_FORMAT:
+		entry->column = CHECK_OPERATION_COLUMN;
+		entry->length = strlen(segments->operation);
+		break;
+	case UNKNOWN_SYMBOL:
+	{
+		char* name = getName(check->lines.lines[lineIndex].symbolId);
+		char* found = strstr(segments->operand, name);
+		entry->column = CHECK_OPERAND_COLUMN + (found ? found - segments->operand : 0);
+		entry->length = found ? strlen(name) : strlen(segments->operand);
+		break;
+	}
+	case ADDRESS_OUT_OF_RANGE:
+	case OUT_OF_RANGE_BYTE:
+	case OUT_OF_RANGE_WORD:
+		entry->column = CHECK_OPERAND_COLUMN;
+		entry->length = strlen(segments->operand);
+		break;
+	}
+}
+
+// Assigns addresses and builds the Symbol Table with the line checks of Pass 1, recording each error of a label
+// or operation
+// A line with an error takes no memory and the walk goes on with the next line
+// Returns false if the program ran past the end of memory, which leaves no addresses to check operands against
+bool checkLabels(sourceCheck* check)
+{
+	jmp_buf recovery;
+	volatile int current = 0;  // Carried across the longjmp of a line with an error
+
+	setErrorRecovery(&recovery);
+	for (int x = 0; x < check->lines.count; x++)
+	{
+		sourceLine* line = &check->lines.lines[x];
+		int errorType;
+
+		setErrorLocation(getName(line->fileId), line->lineNumber);
+		if ((errorType = setjmp(recovery)) != 0)
+		{
+			addDiagnostic(check, x);
+			if (errorType == OUT_OF_MEMORY)
+			{
+				return false;
+			}
+			continue;
+		}
+
+		int increment = assignLineAddress(&check->symbols, line, current);
+		current = line->address + increment;
+	}
+	return true;
+}
+
+// Resolves the operand symbols of BASE, END and each Format 3/4 instruction and encodes the instruction alone
+// with the encoder of Pass 2, recording each unknown symbol and each displacement that neither PC- nor BASE-relative addressing can reach
+void checkOperands(sourceCheck* check)
+{
+	jmp_buf recovery;
+	int rsubId = internName("RSUB");
+	volatile int base = 0;     // Carried across the longjmp of a line with an error
+
+	setErrorRecovery(&recovery);
+	for (int x = 0; x < check->lines.count; x++)
+	{
+		sourceLine* line = &check->lines.lines[x];
+		segment* seg = &line->segments;
+		int directiveType = getDirectiveType(line->operationId);
+
+		setErrorLocation(getName(line->fileId), line->lineNumber);
+		if (setjmp(recovery) != 0)
+		{
+			addDiagnostic(check, x);
+			continue;
+		}
+
+		if (isBaseDirective(directiveType))
+		{
+			base = getSymbolAddress(&check->symbols, line->symbolId);
+			continue;
+		}
+		if (isEndDirective(directiveType) && seg->operand[0] != '\0')
+		{
+			getSymbolAddress(&check->symbols, line->symbolId);
+			continue;
+		}
+
+		// Pass 1 has already reported an operation that is unknown or not valid as Format 4
+		int format = getOperandFormat(line, rsubId);
+		if (format)
+		{
+			address location = { 0, line->address, 0, base };
+			computeFlagsAndAddress(&check->symbols, &location, line, format);
+		}
+	}
+}
+
+// Runs Pass 1 and operand resolution over the source file without writing any output file, then prints its
+// diagnostics as one line of JSON
+// Returns the number of diagnostics
+int checkSource(char* filename)
+{
+	sourceCheck* check = (sourceCheck*)calloc(1, sizeof(sourceCheck));
+	int count;
+
+	initializeSymbolTable(&check->symbols);
+	setErrorCapture(&check->report);
+	lexCheckedSource(check, filename);
+	if (checkLabels(check))
+	{
+		checkOperands(check);
+	}
+	setErrorRecovery(NULL);
+	setErrorCapture(NULL);
+	setErrorLocation(NULL, 0);
+
+	if (check->count > 1)
+	{
+		qsort(check->diagnostics, check->count, sizeof(diagnostic), compareDiagnostics);
+	}
+	writeDiagnostics(filename, check);
+	count = check->count;
+	freeSourceCheck(check);
+	return count;
+}
+
+// Orders diagnostics by their line in the line stream, then by their column within the line
+int compareDiagnostics(const void* first, const void* second)
+{
+	const diagnostic* a = (const diagnostic*)first;
+	const diagnostic* b = (const diagnostic*)second;
+
+	if (a->lineIndex != b->lineIndex)
+	{
+		return a->lineIndex < b->lineIndex ? -1 : 1;
+	}
+	return a->column - b->column;
+}
+
+// Releases the line stream, Symbol Table and diagnostics of a check
+void freeSourceCheck(sourceCheck* check)
+{
+	freeSymbolTable(&check->symbols);
+	freeLineStream(&check->lines);
+	free(check->diagnostics);
+	free(check);
+}
+
+// Lexes the source file into the line stream
+// The reader cannot resume past a line it rejected, so an error of the lexer ends the stream and is the last
+// diagnostic of the file; the lines before it are still checked
+void lexCheckedSource(sourceCheck* check, char* filename)
+{
+	jmp_buf recovery;
+	sourceLine line;
+
+	setErrorRecovery(&recovery);
+	if (setjmp(recovery) == 0)
+	{
+		openSourceReader(&check->reader, filename);
+		while (nextSourceLine(&check->reader, &line))
+		{
+			appendLine(&check->lines, &line);
+		}
+	}
+	else
+	{
+		addDiagnostic(check, check->lines.count);
+	}
+	closeSourceReader(&check->reader);
+}
+
+// Prints the diagnostics of a source file as one JSON object on a line of its own, so an editor can read the
+// results of several files as JSON Lines
+void writeDiagnostics(char* filename, sourceCheck* check)
+{
+	printf("{\"file\":");
+	writeJsonString(filename);
+	printf(",\"diagnostics\":[");
+	for (int x = 0; x < check->count; x++)
+	{
+		diagnostic* entry = &check->diagnostics[x];
+
+		printf("%s{\"file\":", x ? "," : "");
+		writeJsonString(entry->filename != NULL ? entry->filename : filename);
+		printf(",\"line\":%d,\"column\":%d,\"length\":%d,\"severity\":\"error\",\"code\":\"%s\",\"message\":",
+			entry->lineNumber, entry->column, entry->length, errorCodes[entry->errorType]);
+		writeJsonString(entry->message);
+		printf("}");
+	}
+	printf("]}\n");
+}
+
+// Prints a string as a JSON string literal, escaping quotes, backslashes and control characters
+void writeJsonString(char* string)
+{
+	putchar('"');
+	for (unsigned char* c = (unsigned char*)string; *c != '\0'; c++)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			printf("\\%c", *c);
+		}
+		else if (*c < 0x20)
+		{
+			printf("\\u%04X", *c);
+		}
+		else
+		{
+			putchar(*c);
+		}
+	}
+	putchar('"');
+}
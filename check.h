@@ -0,0 +1,30 @@
+#pragma once
+
+#define CHECK_LABEL_COLUMN 1                             // 1-based columns of the fixed segments of a source line
+#define CHECK_OPERATION_COLUMN SEGMENT_SIZE
+#define CHECK_OPERAND_COLUMN (2 * SEGMENT_SIZE - 1)
+
+// Used to report an error found by --check against the segment of the line it is about
+typedef struct diagnostic {
+	int errorType;
+	int lineIndex;               // Line of the line stream; the line count for an error of the lexer
+	char* filename;
+	int lineNumber;              // 0 when the error is about the whole file
+	int column;
+	int length;                  // Characters of the segment; 0 when the error is about the whole line
+	char message[ERROR_MESSAGE_SIZE];
+} diagnostic;
+
+// Used to hold the state of a --check run over a source file
+// Each check recovers from an error through setjmp, so whatever it updates lives here rather than in its locals
+typedef struct sourceCheck {
+	sourceReader reader;
+	lineStream lines;
+	symbolTable symbols;
+	errorReport report;          // Filled in by displayError
+	diagnostic* diagnostics;
+	int count;
+	int capacity;
+} sourceCheck;
+
+int checkSource(char* filename);
@@ -0,0 +1,394 @@
+#include "assembler.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Used to sort the symbols of the debug index by address
+typedef struct addressEntry {
+	int address;
+	int index;
+} addressEntry;
+
+int compareAddressEntries(const void* first, const void* second);
+int compareDebugLines(const void* first, const void* second);
+int compareSymbolNames(const void* first, const void* second);
+int findFileIndex(int fileIds[], int fileCount, int fileId);
+bool hasValidSections(debugHeader* header);
+bool isSectionInFile(long long offset, long long length, long long size);
+void setDebugSections(debugInfo* info, debugHeader* header);
+
+// Builds the debug index from the Symbol Table and the addresses of the line stream
+// The index is a single block of memory laid out exactly like the .dbg file
+void buildDebugInfo(symbolTable* symbols, lineStream* lines, debugInfo* info)
+{
+	symbol** sorted = (symbol**)malloc(sizeof(symbol*) * (symbols->count + 1));
+	int symbolCount = 0, lineCount = 0, stringsSize = 0, fileCount = 0;
+	int* fileIds = (int*)malloc(sizeof(int) * (lines->count + 1));
+	debugHeader* header;
+
+	for (int x = 0; x < symbols->slotCount; x++)
+	{
+		if (symbols->slots[x] != NULL)
+		{
+			sorted[symbolCount++] = symbols->slots[x];
+			stringsSize += strlen(symbols->slots[x]->name) + 1;
+		}
+	}
+	qsort(sorted, symbolCount, sizeof(symbol*), compareSymbolNames);
+
+	// Only lines that occupy memory can be found by address; the name of each file they were read from is stored once
+	for (int x = 0; x < lines->count; x++)
+	{
+		int directiveType = getDirectiveType(lines->lines[x].operationId);
+		int fileId = lines->lines[x].fileId;
+
+		if (!directiveType || isDataDirective(directiveType) || isReserveDirective(directiveType))
+		{
+			lineCount++;
+			if (findFileIndex(fileIds, fileCount, fileId) < 0)
+			{
+				fileIds[fileCount++] = fileId;
+				stringsSize += strlen(getName(fileId)) + 1;
+			}
+		}
+	}
+
+	int symbolsOffset = sizeof(debugHeader);
+	int addressIndexOffset = symbolsOffset + sizeof(debugSymbol) * symbolCount;
+	int linesOffset = addressIndexOffset + sizeof(int) * symbolCount;
+	int stringsOffset = linesOffset + sizeof(debugLine) * lineCount;
+	int size = stringsOffset + stringsSize;
+
+	header = (debugHeader*)calloc(1, size);
+	memcpy(header->magic, DEBUG_INFO_MAGIC, DEBUG_INFO_MAGIC_SIZE);
+	header->version = DEBUG_INFO_VERSION;
+	header->symbolCount = symbolCount;
+	header->lineCount = lineCount;
+	header->symbolsOffset = symbolsOffset;
+	header->addressIndexOffset = addressIndexOffset;
+	header->linesOffset = linesOffset;
+	header->stringsOffset = stringsOffset;
+	header->size = size;
+	setDebugSections(info, header);
+	info->mapped = false;
+
+	addressEntry* byAddress = (addressEntry*)malloc(sizeof(addressEntry) * (symbolCount + 1));
+	int nameOffset = 0;
+	for (int x = 0; x < symbolCount; x++)
+	{
+		strcpy(&info->strings[nameOffset], sorted[x]->name);
+		info->symbols[x].nameOffset = nameOffset;
+		info->symbols[x].address = sorted[x]->address;
+		nameOffset += strlen(sorted[x]->name) + 1;
+
+		byAddress[x].address = sorted[x]->address;
+		byAddress[x].index = x;
+	}
+	qsort(byAddress, symbolCount, sizeof(addressEntry), compareAddressEntries);
+	for (int x = 0; x < symbolCount; x++)
+	{
+		info->addressIndex[x] = byAddress[x].index;
+	}
+	free(byAddress);
+
+	// The file names follow the symbol names; each ID is replaced by the offset of its name
+	int* fileOffsets = (int*)malloc(sizeof(int) * (fileCount + 1));
+	for (int x = 0; x < fileCount; x++)
+	{
+		strcpy(&info->strings[nameOffset], getName(fileIds[x]));
+		fileOffsets[x] = nameOffset;
+		nameOffset += strlen(getName(fileIds[x])) + 1;
+	}
+
+	lineCount = 0;
+	for (int x = 0; x < lines->count; x++)
+	{
+		int directiveType = getDirectiveType(lines->lines[x].operationId);
+		if (!directiveType || isDataDirective(directiveType) || isReserveDirective(directiveType))
+		{
+			info->lines[lineCount].address = lines->lines[x].address;
+			info->lines[lineCount].fileOffset = fileOffsets[findFileIndex(fileIds, fileCount, lines->lines[x].fileId)];
+			info->lines[lineCount++].lineNumber = lines->lines[x].lineNumber;
+		}
+	}
+	qsort(info->lines, lineCount, sizeof(debugLine), compareDebugLines);
+	free(sorted);
+	free(fileOffsets);
+	free(fileIds);
+}
+
+// Orders symbols by address, then by their position in the name order
+int compareAddressEntries(const void* first, const void* second)
+{
+	const addressEntry* a = (const addressEntry*)first;
+	const addressEntry* b = (const addressEntry*)second;
+
+	if (a->address != b->address)
+	{
+		return a->address < b->address ? -1 : 1;
+	}
+	return a->index - b->index;
+}
+
+// Orders line table entries by address, then by line number
+int compareDebugLines(const void* first, const void* second)
+{
+	const debugLine* a = (const debugLine*)first;
+	const debugLine* b = (const debugLine*)second;
+
+	if (a->address != b->address)
+	{
+		return a->address < b->address ? -1 : 1;
+	}
+	return a->lineNumber - b->lineNumber;
+}
+
+// Orders Symbol Table entries by name
+int compareSymbolNames(const void* first, const void* second)
+{
+	return strcmp((*(symbol* const*)first)->name, (*(symbol* const*)second)->name);
+}
+
+// Print the symbols of the debug index to the screen in address order
+// Index is the position of the symbol in the name order of the .dbg file, as the address index stores it
+void displayDebugSymbols(debugInfo* info)
+{
+	printf("\n%-5s  %-8s  %-7s\n", "Index", "  Name  ", "Address");
+	printf("%-5s  %-8s  %-7s\n", "-----", "--------", "-------");
+	for (int x = 0; x < info->header->symbolCount; x++)
+	{
+		debugSymbol* entry = &info->symbols[info->addressIndex[x]];
+		printf("%5d  %-8s  0x%X\n", info->addressIndex[x], getDebugSymbolName(info, entry), entry->address);
+	}
+}
+
+// Performs a binary search of the line table
+// Returns the entry of the line that occupies the provided address; otherwise, NULL
+debugLine* findDebugLine(debugInfo* info, int address)
+{
+	int low = 0, high = info->header->lineCount - 1;
+	debugLine* found = NULL;
+
+	while (low <= high)
+	{
+		int mid = (low + high) / 2;
+		if (info->lines[mid].address <= address)
+		{
+			found = &info->lines[mid];
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid - 1;
+		}
+	}
+	return found;
+}
+
+// Performs a binary search of the address index
+// Returns the symbol with the highest address not above the provided address; otherwise, NULL
+debugSymbol* findDebugSymbolByAddress(debugInfo* info, int address)
+{
+	int low = 0, high = info->header->symbolCount - 1;
+	int found = -1;
+
+	while (low <= high)
+	{
+		int mid = (low + high) / 2;
+		if (info->symbols[info->addressIndex[mid]].address <= address)
+		{
+			found = mid;
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid - 1;
+		}
+	}
+
+	// Prefer the first name of several symbols at the same address
+	while (found > 0 && info->symbols[info->addressIndex[found - 1]].address == info->symbols[info->addressIndex[found]].address)
+	{
+		found--;
+	}
+	return found >= 0 ? &info->symbols[info->addressIndex[found]] : NULL;
+}
+
+// Performs a binary search of the symbols sorted by name
+// Returns the symbol with the provided name; otherwise, NULL
+debugSymbol* findDebugSymbolByName(debugInfo* info, char* name)
+{
+	int low = 0, high = info->header->symbolCount - 1;
+
+	while (low <= high)
+	{
+		int mid = (low + high) / 2;
+		int result = strcmp(getDebugSymbolName(info, &info->symbols[mid]), name);
+		if (result == 0)
+		{
+			return &info->symbols[mid];
+		}
+		else if (result < 0)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid - 1;
+		}
+	}
+	return NULL;
+}
+
+// Returns the index of the file ID among the files of the line table; otherwise, -1
+// A source includes few files, so a linear search is enough
+int findFileIndex(int fileIds[], int fileCount, int fileId)
+{
+	for (int x = fileCount - 1; x >= 0; x--)
+	{
+		if (fileIds[x] == fileId)
+		{
+			return x;
+		}
+	}
+	return -1;
+}
+
+// Releases the memory or the mapping that holds the debug index
+void freeDebugInfo(debugInfo* info)
+{
+	if (info->header == NULL)
+	{
+		return;
+	}
+	if (info->mapped)
+	{
+		munmap(info->header, info->header->size);
+	}
+	else
+	{
+		free(info->header);
+	}
+	info->header = NULL;
+}
+
+// Returns the name of the file the provided line of the debug index was read from
+char* getDebugLineFile(debugInfo* info, debugLine* entry)
+{
+	return &info->strings[entry->fileOffset];
+}
+
+// Returns the name of the provided symbol of the debug index
+char* getDebugSymbolName(debugInfo* info, debugSymbol* entry)
+{
+	return &info->strings[entry->nameOffset];
+}
+
+// Returns true if every section of a mapped .dbg file lies within the file, every symbol index is in range and
+// every offset into the string table names a string that ends within it; otherwise, false
+bool hasValidSections(debugHeader* header)
+{
+	char* base = (char*)header;
+	long long size = header->size;
+	long long stringsSize = size - header->stringsOffset;
+	debugSymbol* symbols = (debugSymbol*)(base + header->symbolsOffset);
+	int* addressIndex = (int*)(base + header->addressIndexOffset);
+	debugLine* lines = (debugLine*)(base + header->linesOffset);
+
+	if (header->symbolCount < 0 || header->lineCount < 0 ||
+			!isSectionInFile(header->symbolsOffset, (long long)sizeof(debugSymbol) * header->symbolCount, size) ||
+			!isSectionInFile(header->addressIndexOffset, (long long)sizeof(int) * header->symbolCount, size) ||
+			!isSectionInFile(header->linesOffset, (long long)sizeof(debugLine) * header->lineCount, size) ||
+			!isSectionInFile(header->stringsOffset, 0, size))
+	{
+		return false;
+	}
+	if (stringsSize > 0 && base[size - 1] != '\0')
+	{
+		return false;
+	}
+
+	for (int x = 0; x < header->symbolCount; x++)
+	{
+		if (symbols[x].nameOffset < 0 || symbols[x].nameOffset >= stringsSize ||
+				addressIndex[x] < 0 || addressIndex[x] >= header->symbolCount)
+		{
+			return false;
+		}
+	}
+	for (int x = 0; x < header->lineCount; x++)
+	{
+		if (lines[x].fileOffset < 0 || lines[x].fileOffset >= stringsSize)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Returns true if a section of the provided length starts after the header at an offset aligned for its
+// entries and ends within the file; otherwise, false
+bool isSectionInFile(long long offset, long long length, long long size)
+{
+	return offset >= (long long)sizeof(debugHeader) && offset % sizeof(int) == 0 && offset + length <= size;
+}
+
+// Maps a .dbg file into memory so it can be searched without being parsed
+void mapDebugInfo(char* filename, debugInfo* info)
+{
+	struct stat status;
+	debugHeader* header;
+	int file = open(filename, O_RDONLY);
+
+	if (file < 0)
+	{
+		displayError(FILE_NOT_FOUND, filename);
+		exit(-1);
+	}
+
+	fstat(file, &status);
+	if (status.st_size < (off_t)sizeof(debugHeader))
+	{
+		displayError(ILLEGAL_FILE_FORMAT, filename);
+		exit(-1);
+	}
+
+	header = (debugHeader*)mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (header == MAP_FAILED || memcmp(header->magic, DEBUG_INFO_MAGIC, DEBUG_INFO_MAGIC_SIZE) != 0 ||
+			header->version != DEBUG_INFO_VERSION || header->size != status.st_size || !hasValidSections(header))
+	{
+		displayError(ILLEGAL_FILE_FORMAT, filename);
+		exit(-1);
+	}
+
+	setDebugSections(info, header);
+	info->mapped = true;
+}
+
+// Points each section of the debug index into the block that starts with the provided header
+void setDebugSections(debugInfo* info, debugHeader* header)
+{
+	char* base = (char*)header;
+
+	info->header = header;
+	info->symbols = (debugSymbol*)(base + header->symbolsOffset);
+	info->addressIndex = (int*)(base + header->addressIndexOffset);
+	info->lines = (debugLine*)(base + header->linesOffset);
+	info->strings = base + header->stringsOffset;
+}
+
+// Writes the debug index to a .dbg file
+void writeDebugInfo(char* filename, debugInfo* info)
+{
+	FILE* file = fopen(filename, "wb");
+
+	if (!file)
+	{
+		displayError(FILE_NOT_FOUND, filename);
+		exit(-1);
+	}
+	fwrite(info->header, 1, info->header->size, file);
+	fclose(file);
+}
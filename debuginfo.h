@@ -0,0 +1,52 @@
+#pragma once
+
+#define DEBUG_INFO_MAGIC "SICD"
+#define DEBUG_INFO_MAGIC_SIZE 4
+#define DEBUG_INFO_VERSION 2
+
+// Used to describe the layout of a .dbg file; every offset is from the start of the file
+typedef struct debugHeader {
+	char magic[DEBUG_INFO_MAGIC_SIZE];
+	int version;
+	int symbolCount;
+	int lineCount;
+	int symbolsOffset;       // debugSymbol entries sorted by name
+	int addressIndexOffset;  // Symbol indexes sorted by address
+	int linesOffset;         // debugLine entries sorted by address
+	int stringsOffset;       // '\0'-terminated symbol and source file names
+	int size;
+} debugHeader;
+
+// Used to store a symbol of the debug index
+typedef struct debugSymbol {
+	int nameOffset;          // From the start of the string table
+	int address;
+} debugSymbol;
+
+// Used to map an address to the source line that occupies it
+typedef struct debugLine {
+	int address;
+	int fileOffset;          // Name of the file the line was read from, from the start of the string table
+	int lineNumber;
+} debugLine;
+
+// Used to access a debug index that was built in memory or mapped from a .dbg file
+typedef struct debugInfo {
+	debugHeader* header;
+	debugSymbol* symbols;
+	int* addressIndex;
+	debugLine* lines;
+	char* strings;
+	bool mapped;
+} debugInfo;
+
+void buildDebugInfo(symbolTable* symbols, lineStream* lines, debugInfo* info);
+void displayDebugSymbols(debugInfo* info);
+debugLine* findDebugLine(debugInfo* info, int address);
+debugSymbol* findDebugSymbolByAddress(debugInfo* info, int address);
+debugSymbol* findDebugSymbolByName(debugInfo* info, char* name);
+void freeDebugInfo(debugInfo* info);
+char* getDebugLineFile(debugInfo* info, debugLine* entry);
+char* getDebugSymbolName(debugInfo* info, debugSymbol* entry);
+void mapDebugInfo(char* filename, debugInfo* info);
+void writeDebugInfo(char* filename, debugInfo* info);
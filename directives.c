@@ -7,7 +7,7 @@
  *        DO NOT REMOVE THIS MESSAGE
  **********************************************/
 
-#include "headers.h"
+#include "assembler.h"
 
 #define SINGLE_QUOTE 39
 
@@ -15,9 +15,13 @@
 enum directives {
 	// Although ERROR is not a valid directive, 
 	// its presence helps the isDirective() function
-	ERROR, BASE, BYTE, END, RESB, RESW, START
+	ERROR, BASE, BYTE, ELSE, END, ENDIF, IF, INCLUDE, MACRO, MEND, RESB, RESW, START
 };
 
+// Directive type of each interned name ID below directiveIdCount; ERROR for names that are not directives
+int* directiveTypes = NULL;
+int directiveIdCount = 0;
+
 // Returns the value associated with a BYTE directive
 int getByteValue(int directiveType, char* string)
 {
@@ -49,7 +53,13 @@ int getMemoryAmount(int directiveType, char* string)
 	switch (directiveType)
 	{
 	case BASE:
+	case ELSE:
 	case END:
+	case ENDIF:
+	case IF:
+	case INCLUDE:
+	case MACRO:
+	case MEND:
 	case START:
 		return 0;
 		break;
@@ -77,6 +87,33 @@ int getMemoryAmount(int directiveType, char* string)
 	return -1; // Should not happen
 }
 
+// Returns the directive type of the interned name; otherwise, ERROR
+// A lexed line is classified by its operation ID without comparing strings
+int getDirectiveType(int nameId)
+{
+	return nameId >= 0 && nameId < directiveIdCount ? directiveTypes[nameId] : ERROR;
+}
+
+// Interns the name of every directive and records its type by name ID
+// Called once before any source is lexed, so the table is never written while a pipeline stage reads it
+void internDirectives(void)
+{
+	char* names[] = { "BASE", "BYTE", "ELSE", "END", "ENDIF", "IF", "INCLUDE", "MACRO", "MEND", "RESB", "RESW", "START" };
+	int count = sizeof(names) / sizeof(names[0]);
+	int ids[sizeof(names) / sizeof(names[0])];
+
+	for (int x = 0; x < count; x++)
+	{
+		ids[x] = internName(names[x]);
+		directiveIdCount = ids[x] >= directiveIdCount ? ids[x] + 1 : directiveIdCount;
+	}
+	directiveTypes = (int*)calloc(directiveIdCount, sizeof(int));
+	for (int x = 0; x < count; x++)
+	{
+		directiveTypes[ids[x]] = isDirective(names[x]);
+	}
+}
+
 // Returns true if the provided directive type is the BASE directive; otherwise, false
 bool isBaseDirective(int directiveType)
 {
@@ -96,19 +133,61 @@ int isDirective(char* string)
 {
 	if (strcmp(string, "BASE") == 0) { return BASE; }
 	else if (strcmp(string, "BYTE") == 0) { return BYTE; }
+	else if (strcmp(string, "ELSE") == 0) { return ELSE; }
 	else if(strcmp(string, "END") == 0) { return END; }
+	else if (strcmp(string, "ENDIF") == 0) { return ENDIF; }
+	else if (strcmp(string, "IF") == 0) { return IF; }
+	else if (strcmp(string, "INCLUDE") == 0) { return INCLUDE; }
+	else if (strcmp(string, "MACRO") == 0) { return MACRO; }
+	else if (strcmp(string, "MEND") == 0) { return MEND; }
 	else if (strcmp(string, "RESB") == 0) { return RESB; }
 	else if (strcmp(string, "RESW") == 0) { return RESW; }
 	else if (strcmp(string, "START") == 0) { return START; }
 	else { return ERROR; }
 }
 
+// Returns true if the provided directive type is the ELSE directive; otherwise, false
+bool isElseDirective(int directiveType)
+{
+	return directiveType == ELSE;
+}
+
 // Returns true if the provided directive type is the END directive; otherwise, false
 bool isEndDirective(int directiveType)
 {
 	return directiveType == END;
 }
 
+// Returns true if the provided directive type is the ENDIF directive; otherwise, false
+bool isEndifDirective(int directiveType)
+{
+	return directiveType == ENDIF;
+}
+
+// Returns true if the provided directive type is the IF directive; otherwise, false
+bool isIfDirective(int directiveType)
+{
+	return directiveType == IF;
+}
+
+// Returns true if the provided directive type is the INCLUDE directive; otherwise, false
+bool isIncludeDirective(int directiveType)
+{
+	return directiveType == INCLUDE;
+}
+
+// Returns true if the provided directive type is the MACRO directive; otherwise, false
+bool isMacroDirective(int directiveType)
+{
+	return directiveType == MACRO;
+}
+
+// Returns true if the provided directive type is the MEND directive; otherwise, false
+bool isMendDirective(int directiveType)
+{
+	return directiveType == MEND;
+}
+
 // Returns true if the provided directive type is the RESB or RESW directive; otherwise, false
 bool isReserveDirective(int directiveType)
 {
@@ -0,0 +1,620 @@
+#include "assembler.h"
+#include <unistd.h>
+
+#define DECIMAL_DIGITS_MAX 10
+#define FIELD_WIDTH 8
+#define HEX_DIGITS "0123456789ABCDEF"
+#define HEX_DIGITS_MAX 8
+#define LABEL_PREFIX 'L'
+#define LABEL_DIGITS 5
+#define LDB_OPCODE 0x68
+#define MARK_LINE_START 0x01
+#define MARK_REFERENCED 0x02
+#define NI_IMMEDIATE 1
+#define NI_INDIRECT 2
+#define NI_MASK 0x03
+#define NI_SIC 0
+#define OPERAND_WIDTH 11
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define OUTPUT_LINE_SIZE 64
+#define REGISTER_COUNT_MAX 10
+#define RSUB_OPCODE 0x4C
+#define SIC_ADDRESS_MASK 0x7FFF
+#define WORD_SIZE 3
+
+// Used to store one line of the disassembly before it is written
+typedef struct decodedLine {
+	char label[SEGMENT_SIZE];
+	char operation[SEGMENT_SIZE];
+	char operand[SEGMENT_SIZE * 2];  // Room for a Format 4 constant with ",X"
+	int length;                      // Bytes of object code; 0 for lines without object code
+	int code;
+	char* sourceName;                // File of the source line at the address, from the debug index; otherwise, NULL
+	int lineNumber;
+	int target;                      // Address the operand refers to; -1 when the operand is not an address
+	bool loadsBase;                  // LDB with an immediate operand, which is followed by a BASE line
+} decodedLine;
+
+// Used to name the addresses that operands refer to, so the disassembly assembles back into the same bytes
+// The assembler takes no numeric address operands, so an address without a symbol is given a generated label
+typedef struct disassemblyLabels {
+	debugInfo* info;                 // Symbols of the debug index; NULL when there is no .dbg file
+	memoryImage* image;
+	unsigned char* marks;            // MARK_LINE_START and MARK_REFERENCED bits of each address
+} disassemblyLabels;
+
+// Used to collect lines of the disassembly so they reach the file in large writes
+typedef struct disassemblyOutput {
+	FILE* file;
+	char* text;
+	int length;
+} disassemblyOutput;
+
+int appendField(char* text, int length, int column);
+int appendText(char* text, int length, char* value);
+int decodeInstruction(decodeEntry table[], memoryImage* image, int address, int* base, disassemblyLabels* labels, decodedLine* line);
+int findLabel(debugInfo* info, int* cursor, int address, char* label);
+char* formatNumber(char* text, unsigned int value, unsigned int radix);
+void findSourceLine(debugInfo* info, int* cursor, int address, decodedLine* line);
+void flushDisassembly(disassemblyOutput* output);
+void formatLabel(char* label, int address);
+void formatTarget(char* operand, int target, disassemblyLabels* labels);
+bool hasGeneratedLabel(disassemblyLabels* labels, int address);
+void markTargets(decodeEntry table[], memoryImage* image, unsigned char* marks);
+void writeDisassemblyLine(disassemblyOutput* output, int address, decodedLine* line);
+
+// Names of the Format 2 registers, indexed by register number; 7 is not a register
+char* registerNames[REGISTER_COUNT_MAX] = { "A", "X", "L", "B", "S", "T", "F", NULL, "PC", "SW" };
+
+// Pads the line with spaces up to the provided column
+// Returns the new length of the line
+int appendField(char* text, int length, int column)
+{
+	while (length < column)
+	{
+		text[length++] = ' ';
+	}
+	return length;
+}
+
+// Copies the string to the end of the line
+// Returns the new length of the line
+int appendText(char* text, int length, char* value)
+{
+	while (*value != '\0')
+	{
+		text[length++] = *value++;
+	}
+	return length;
+}
+
+// Fills the 256-entry decode table from the opcodes array
+// A Format 3/4 opcode owns the four first-byte values formed by its n and i bits
+void buildDecodeTable(decodeEntry table[])
+{
+	char* name;
+	int format, value;
+
+	memset(table, 0, sizeof(decodeEntry) * DECODE_TABLE_SIZE);
+	for (int x = 0; (name = getOpcodeEntry(x, &format, &value)) != NULL; x++)
+	{
+		int operands = REGISTER_PAIR;
+		if (strcmp(name, "CLEAR") == 0 || strcmp(name, "TIXR") == 0)
+		{
+			operands = REGISTER_ONLY;
+		}
+		else if (strcmp(name, "SHIFTL") == 0 || strcmp(name, "SHIFTR") == 0)
+		{
+			operands = REGISTER_COUNT;
+		}
+		else if (strcmp(name, "SVC") == 0)
+		{
+			operands = INTERRUPT_NUMBER;
+		}
+
+		for (int y = 0; y < (format == FORMAT_3 ? NI_MASK + 1 : 1); y++)
+		{
+			table[value + y] = (decodeEntry){ name, format, value, operands };
+		}
+	}
+}
+
+// Decodes the instruction at the provided address into a listing line
+// LDB with an immediate operand sets the base used by later BASE-relative instructions
+// Without labels, only the length, target and base are decoded, which is all markTargets needs
+// Returns the length of the instruction; otherwise, 0 (the bytes are not an instruction)
+int decodeInstruction(decodeEntry table[], memoryImage* image, int address, int* base, disassemblyLabels* labels, decodedLine* line)
+{
+	unsigned char* bytes = &image->bytes[address];
+	decodeEntry* entry = &table[bytes[0]];
+	char* operand = line->operand;
+	bool constant = false;
+	int ni, flags, target, length = 3;
+
+	line->target = -1;
+	line->loadsBase = false;
+	if (entry->name == NULL)
+	{
+		return 0;
+	}
+	strcpy(line->operation, entry->name);
+
+	if (entry->format == FORMAT_1)
+	{
+		line->code = bytes[0];
+		return line->length = 1;
+	}
+	if (!isLoaded(image, address, 2))
+	{
+		return 0;
+	}
+
+	if (entry->format == FORMAT_2)
+	{
+		int first = bytes[1] >> 4, second = bytes[1] & 0x0F, end;
+		bool validFirst = first < REGISTER_COUNT_MAX && registerNames[first] != NULL;
+		bool validSecond = second < REGISTER_COUNT_MAX && registerNames[second] != NULL;
+
+		if (entry->operands == REGISTER_ONLY && validFirst && second == 0)
+		{
+			strcpy(operand, registerNames[first]);
+		}
+		else if (entry->operands == REGISTER_COUNT && validFirst)
+		{
+			end = appendText(operand, 0, registerNames[first]);
+			operand[end++] = ',';
+			formatNumber(&operand[end], second + 1, 10);
+		}
+		else if (entry->operands == INTERRUPT_NUMBER && second == 0)
+		{
+			formatNumber(operand, first, 10);
+		}
+		else if (entry->operands == REGISTER_PAIR && validFirst && validSecond)
+		{
+			end = appendText(operand, 0, registerNames[first]);
+			operand[end++] = ',';
+			operand[appendText(operand, end, registerNames[second])] = '\0';
+		}
+		else
+		{
+			return 0;
+		}
+		line->code = (bytes[0] << 8) | bytes[1];
+		return line->length = 2;
+	}
+
+	if (!isLoaded(image, address, 3))
+	{
+		return 0;
+	}
+	ni = bytes[0] & NI_MASK;
+	flags = bytes[1] >> 4;
+
+	if (ni == NI_SIC)
+	{
+		// Standard SIC instruction: the x bit followed by a 15-bit address
+		target = ((bytes[1] << 8) | bytes[2]) & SIC_ADDRESS_MASK;
+		flags &= FLAG_X;
+	}
+	else if (flags & FLAG_E)
+	{
+		if (!isLoaded(image, address, 4) || (flags & (FLAG_B | FLAG_P)))
+		{
+			return 0;
+		}
+		length = 4;
+		target = ((bytes[1] & 0x0F) << 16) | (bytes[2] << 8) | bytes[3];
+		constant = ni == NI_IMMEDIATE;
+	}
+	else
+	{
+		int displacement = ((bytes[1] & 0x0F) << 8) | bytes[2];
+		if ((flags & FLAG_B) && (flags & FLAG_P))
+		{
+			return 0;
+		}
+		else if (flags & FLAG_P)
+		{
+			// Sign-extend the 12-bit displacement
+			target = address + length + (displacement ^ 0x800) - 0x800;
+		}
+		else if (flags & FLAG_B)
+		{
+			target = *base + displacement;
+		}
+		else
+		{
+			target = displacement;
+			constant = ni == NI_IMMEDIATE;
+		}
+	}
+
+	if (entry->value == LDB_OPCODE && ni == NI_IMMEDIATE)
+	{
+		*base = target;
+		line->loadsBase = true;
+	}
+	if (!constant && !(entry->value == RSUB_OPCODE && target == 0 && !(flags & FLAG_X)))
+	{
+		line->target = target;
+	}
+	if (labels == NULL)
+	{
+		return length;
+	}
+
+	line->code = 0;
+	for (int x = 0; x < length; x++)
+	{
+		line->code = (line->code << 8) | bytes[x];
+	}
+	if (length == 4)
+	{
+		line->operation[0] = '+';
+		strcpy(&line->operation[1], entry->name);
+	}
+
+	if (entry->value == RSUB_OPCODE && target == 0 && !(flags & FLAG_X))
+	{
+		operand[0] = '\0';
+	}
+	else
+	{
+		if (ni == NI_IMMEDIATE)
+		{
+			*operand++ = IMMEDIATE_CHARACTER;
+		}
+		else if (ni == NI_INDIRECT)
+		{
+			*operand++ = INDIRECT_CHARACTER;
+		}
+
+		if (constant)
+		{
+			formatNumber(operand, target, 10);
+		}
+		else
+		{
+			formatTarget(operand, target, labels);
+		}
+		if (flags & FLAG_X)
+		{
+			strcat(operand, INDEX_STRING);
+		}
+	}
+	return line->length = length;
+}
+
+// Disassembles a .obj file or raw memory image into a file laid out like the listing
+// Symbols from the debug index are used when the .dbg file exists
+void disassembleFile(char* filename, char* outputName, char* debugName)
+{
+	memoryImage image;
+	debugInfo info = { NULL };
+	FILE* file;
+
+	loadMemoryImage(filename, &image);
+	if (access(debugName, R_OK) == 0)
+	{
+		mapDebugInfo(debugName, &info);
+	}
+
+	if (!(file = fopen(outputName, "w")))
+	{
+		displayError(FILE_NOT_FOUND, outputName);
+		exit(-1);
+	}
+	disassembleImage(file, &image, info.header ? &info : NULL);
+	fclose(file);
+
+	freeDebugInfo(&info);
+	freeMemoryImage(&image);
+}
+
+// Writes the disassembly of every address from the start to the end of the image
+// Bytes that do not decode are written as BYTE and areas that were not loaded as RESB
+void disassembleImage(FILE* file, memoryImage* image, debugInfo* info)
+{
+	decodeEntry table[DECODE_TABLE_SIZE];
+	decodedLine line = { 0 };
+	disassemblyOutput output = { file, (char*)malloc(OUTPUT_BUFFER_SIZE), 0 };
+	disassemblyLabels labels = { info, image, (unsigned char*)calloc(MEMORY_SIZE, 1) };
+	int address = image->start;
+	int base = 0, cursor = 0, lineCursor = 0;
+
+	buildDecodeTable(table);
+	markTargets(table, image, labels.marks);
+
+	strcpy(line.label, image->name);
+	strcpy(line.operation, "START");
+	sprintf(line.operand, "%X", image->start);
+	writeDisassemblyLine(&output, address, &line);
+
+	while (address < image->end)
+	{
+		int limit = findLabel(info, &cursor, address, line.label);
+		if (line.label[0] == '\0' && hasGeneratedLabel(&labels, address))
+		{
+			formatLabel(line.label, address);
+		}
+		findSourceLine(info, &lineCursor, address, &line);
+		line.length = 0;
+		line.operand[0] = '\0';
+
+		if (!image->loaded[address])
+		{
+			// A gap ends at the next label so each reserved symbol keeps its own line
+			int gap = address + 1;
+			while (gap < image->end && gap < limit && !image->loaded[gap] && !(labels.marks[gap] & MARK_REFERENCED))
+			{
+				gap++;
+			}
+			if ((gap - address) % WORD_SIZE == 0)
+			{
+				strcpy(line.operation, "RESW");
+				formatNumber(line.operand, (gap - address) / WORD_SIZE, 10);
+			}
+			else
+			{
+				strcpy(line.operation, "RESB");
+				formatNumber(line.operand, gap - address, 10);
+			}
+			writeDisassemblyLine(&output, address, &line);
+			address = gap;
+			continue;
+		}
+
+		if (decodeInstruction(table, image, address, &base, &labels, &line) == 0)
+		{
+			strcpy(line.operation, "BYTE");
+			strcpy(line.operand, "X'00'");
+			line.operand[2] = HEX_DIGITS[image->bytes[address] >> 4];
+			line.operand[3] = HEX_DIGITS[image->bytes[address] & 0x0F];
+			line.code = image->bytes[address];
+			line.length = 1;
+		}
+		writeDisassemblyLine(&output, address, &line);
+		address += line.length;
+
+		// The assembler only uses BASE-relative addressing after a BASE directive
+		if (line.loadsBase)
+		{
+			line.label[0] = '\0';
+			strcpy(line.operation, "BASE");
+			formatTarget(line.operand, base, &labels);
+			line.length = 0;
+			line.sourceName = NULL;
+			writeDisassemblyLine(&output, address, &line);
+		}
+	}
+
+	// END has no line terminator, as in the listing
+	line.label[0] = '\0';
+	formatTarget(line.operand, image->entry, &labels);
+	flushDisassembly(&output);
+	fprintf(file, "%-8X%-8s%-8s%-11s", address, line.label, "END", line.operand);
+	free(output.text);
+	free(labels.marks);
+}
+
+// Copies the name of the symbol at the provided address into the label; otherwise, an empty label
+// The cursor walks the symbols in address order, so addresses must be visited in increasing order
+// Returns the address of the next symbol after the provided address; otherwise, MEMORY_SIZE
+int findLabel(debugInfo* info, int* cursor, int address, char* label)
+{
+	label[0] = '\0';
+	if (info == NULL)
+	{
+		return MEMORY_SIZE;
+	}
+
+	int count = info->header->symbolCount;
+	while (*cursor < count && info->symbols[info->addressIndex[*cursor]].address < address)
+	{
+		(*cursor)++;
+	}
+	if (*cursor < count && info->symbols[info->addressIndex[*cursor]].address == address)
+	{
+		strcpy(label, getDebugSymbolName(info, &info->symbols[info->addressIndex[*cursor]]));
+	}
+
+	for (int x = *cursor; x < count; x++)
+	{
+		if (info->symbols[info->addressIndex[x]].address > address)
+		{
+			return info->symbols[info->addressIndex[x]].address;
+		}
+	}
+	return MEMORY_SIZE;
+}
+
+// Records the file and line number of the first source line at the provided address; otherwise, no source line
+// The cursor walks the line table, so addresses must be visited in increasing order
+void findSourceLine(debugInfo* info, int* cursor, int address, decodedLine* line)
+{
+	line->sourceName = NULL;
+	if (info == NULL)
+	{
+		return;
+	}
+
+	while (*cursor < info->header->lineCount && info->lines[*cursor].address < address)
+	{
+		(*cursor)++;
+	}
+	if (*cursor < info->header->lineCount && info->lines[*cursor].address == address)
+	{
+		line->sourceName = getDebugLineFile(info, &info->lines[*cursor]);
+		line->lineNumber = info->lines[*cursor].lineNumber;
+	}
+}
+
+// Writes the collected lines of the disassembly to its file
+void flushDisassembly(disassemblyOutput* output)
+{
+	fwrite(output->text, 1, output->length, output->file);
+	output->length = 0;
+}
+
+// Writes the generated label of an address, 'L' and the address as LABEL_DIGITS hex digits
+void formatLabel(char* label, int address)
+{
+	label[0] = LABEL_PREFIX;
+	for (int x = LABEL_DIGITS; x > 0; x--)
+	{
+		label[x] = HEX_DIGITS[address & 0x0F];
+		address >>= 4;
+	}
+	label[LABEL_DIGITS + 1] = '\0';
+}
+
+// Names the target address with the symbol at that address, or with its generated label; otherwise, writes
+// it in hex as X'..', which the assembler rejects rather than reading as a decimal constant
+void formatTarget(char* operand, int target, disassemblyLabels* labels)
+{
+	debugSymbol* entry = labels && labels->info ? findDebugSymbolByAddress(labels->info, target) : NULL;
+
+	if (entry != NULL && entry->address == target)
+	{
+		strcpy(operand, getDebugSymbolName(labels->info, entry));
+	}
+	else if (labels && hasGeneratedLabel(labels, target))
+	{
+		formatLabel(operand, target);
+	}
+	else
+	{
+		operand[0] = 'X';
+		operand[1] = '\'';
+		operand = formatNumber(&operand[2], (unsigned int)target, 16);
+		operand[0] = '\'';
+		operand[1] = '\0';
+	}
+}
+
+// Returns true if an operand refers to the address and a line of the disassembly starts there; otherwise, false
+// Every address of a gap can start a line, since a gap is split at each address referred to
+bool hasGeneratedLabel(disassemblyLabels* labels, int address)
+{
+	if (address < labels->image->start || address >= labels->image->end)
+	{
+		return false;
+	}
+	return (labels->marks[address] & MARK_REFERENCED) &&
+		((labels->marks[address] & MARK_LINE_START) || !labels->image->loaded[address]);
+}
+
+// Writes the value in the provided radix followed by a '\0', as sprintf would with "%u" or "%X"
+// Returns the position of the '\0'
+char* formatNumber(char* text, unsigned int value, unsigned int radix)
+{
+	char digits[DECIMAL_DIGITS_MAX];
+	int count = 0;
+
+	do
+	{
+		digits[count++] = HEX_DIGITS[value % radix];
+		value /= radix;
+	} while (value > 0);
+	while (count > 0)
+	{
+		*text++ = digits[--count];
+	}
+	*text = '\0';
+	return text;
+}
+
+// Returns true if every byte of the provided range was loaded; otherwise, false
+bool isLoaded(memoryImage* image, int address, int length)
+{
+	if (address + length > image->end)
+	{
+		return false;
+	}
+	for (int x = 1; x < length; x++)
+	{
+		if (!image->loaded[address + x])
+		{
+			return false;
+		}
+	}
+	return image->loaded[address];
+}
+
+// Marks the address of each line of the loaded areas and each address an operand or the entry point refers to
+// Walks the image as disassembleImage does, so the lines start at the same addresses in both
+void markTargets(decodeEntry table[], memoryImage* image, unsigned char* marks)
+{
+	decodedLine line;
+	int address = image->start;
+	int base = 0;
+
+	if (image->entry >= image->start && image->entry < image->end)
+	{
+		marks[image->entry] |= MARK_REFERENCED;
+	}
+	while (address < image->end)
+	{
+		if (!image->loaded[address])
+		{
+			address++;
+			continue;
+		}
+
+		int length = decodeInstruction(table, image, address, &base, NULL, &line);
+		marks[address] |= MARK_LINE_START;
+		if (length > 0 && line.target >= image->start && line.target < image->end)
+		{
+			marks[line.target] |= MARK_REFERENCED;
+		}
+		address += length > 0 ? length : 1;
+	}
+}
+
+// Adds a line in the layout used by writeToLstFile, "%-8X%-8s%-8s%-11s %0nX", to the output, followed by its
+// source location when it has one
+// Lines are formatted by hand into one large buffer, since fprintf and a locked fwrite for each line dominate
+// the time spent on a full address space
+void writeDisassemblyLine(disassemblyOutput* output, int address, decodedLine* line)
+{
+	char hex[HEX_DIGITS_MAX];
+	char* text;
+	int length = 0, digits = 0;
+
+	if (output->length + OUTPUT_LINE_SIZE + (line->sourceName ? (int)strlen(line->sourceName) : 0) > OUTPUT_BUFFER_SIZE)
+	{
+		flushDisassembly(output);
+	}
+	text = &output->text[output->length];
+
+	do
+	{
+		hex[digits++] = HEX_DIGITS[address & 0x0F];
+		address >>= 4;
+	} while (address > 0);
+	while (digits > 0)
+	{
+		text[length++] = hex[--digits];
+	}
+	length = appendField(text, length, FIELD_WIDTH);
+	length = appendField(text, appendText(text, length, line->label), FIELD_WIDTH * 2);
+	length = appendField(text, appendText(text, length, line->operation), FIELD_WIDTH * 3);
+	length = appendField(text, appendText(text, length, line->operand), FIELD_WIDTH * 3 + OPERAND_WIDTH);
+
+	if (line->length > 0)
+	{
+		text[length++] = ' ';
+		for (int x = line->length * 2 - 1; x >= 0; x--)
+		{
+			text[length++] = HEX_DIGITS[(line->code >> (x * 4)) & 0x0F];
+		}
+	}
+	if (line->sourceName != NULL)
+	{
+		length = appendText(text, appendText(text, length, "  # "), line->sourceName);
+		text[length++] = ':';
+		length = formatNumber(&text[length], line->lineNumber, 10) - text;
+	}
+	text[length++] = '\n';
+	output->length += length;
+}
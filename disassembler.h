@@ -0,0 +1,22 @@
+#pragma once
+
+#define DECODE_TABLE_SIZE 256
+
+// Format 2 operand layouts
+enum registerOperands { REGISTER_PAIR, REGISTER_ONLY, REGISTER_COUNT, INTERRUPT_NUMBER };
+
+// Used to decode an instruction from its first byte without searching the opcodes array
+typedef struct decodeEntry {
+	char* name;              // NULL when no instruction starts with this byte
+	int format;
+	int value;
+	int operands;            // Format 2 operand layout
+} decodeEntry;
+
+void buildDecodeTable(decodeEntry table[]);
+void disassembleFile(char* filename, char* outputName, char* debugName);
+void disassembleImage(FILE* file, memoryImage* image, debugInfo* info);
+bool isLoaded(memoryImage* image, int address, int length);
+
+// Reads an entry of the opcodes array; defined in opcodes.c
+char* getOpcodeEntry(int index, int* format, int* value);
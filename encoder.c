@@ -0,0 +1,181 @@
+#include "assembler.h"
+
+// Format 4 always uses simple n and i flags unless the operand is an immediate constant
+addressingTemplate addressingTemplates[MODE_COUNT] = {
+	// Format 3
+	{3,0,false,false}, {3,FLAG_X,false,false}, {1,0,false,false}, {1,FLAG_X,false,false},
+	{2,0,false,false}, {2,FLAG_X,false,false}, {1,0,false,true},  {1,0,false,true},
+	// Format 4
+	{3,0,true,false},  {3,FLAG_X,true,false},  {3,0,true,false},  {3,FLAG_X,true,false},
+	{3,0,true,false},  {3,FLAG_X,true,false},  {1,0,true,true},   {1,0,true,true}
+};
+
+// Appends a resolved Format 3/4 instruction to the batch
+void addInstruction(instructionBatch* batch, int opcode, int mode, int target, int pc, int base)
+{
+	if (batch->count == batch->capacity)
+	{
+		batch->capacity = batch->capacity ? batch->capacity * 2 : 64;
+		batch->opcodes = (int*)realloc(batch->opcodes, sizeof(int) * batch->capacity);
+		batch->modes = (int*)realloc(batch->modes, sizeof(int) * batch->capacity);
+		batch->targets = (int*)realloc(batch->targets, sizeof(int) * batch->capacity);
+		batch->pcs = (int*)realloc(batch->pcs, sizeof(int) * batch->capacity);
+		batch->bases = (int*)realloc(batch->bases, sizeof(int) * batch->capacity);
+		batch->codes = (int*)realloc(batch->codes, sizeof(int) * batch->capacity);
+	}
+	batch->opcodes[batch->count] = opcode & 0xFC;
+	batch->modes[batch->count] = mode;
+	batch->targets[batch->count] = target;
+	batch->pcs[batch->count] = pc;
+	batch->bases[batch->count] = base;
+	batch->count++;
+}
+
+// Determines the addressing mode of a Format 3/4 operand and copies the symbol name or
+// constant it refers to, without its '#', '@' or ",X"
+// Returns the index of the addressing mode template
+int classifyAddressing(char* operand, int format, char* symbolName)
+{
+	int mode = MODE_SIMPLE;
+	char* comma;
+
+	if (operand[0] == IMMEDIATE_CHARACTER)
+	{
+		mode = MODE_IMMEDIATE;
+		operand++;
+	}
+	else if (operand[0] == INDIRECT_CHARACTER)
+	{
+		mode = MODE_INDIRECT;
+		operand++;
+	}
+
+	strcpy(symbolName, operand);
+	if ((comma = strstr(symbolName, INDEX_STRING)) != NULL)
+	{
+		*comma = '\0';
+		mode++;
+	}
+
+	if (mode >= MODE_IMMEDIATE && mode <= MODE_IMMEDIATE_INDEXED && isNumeric(symbolName))
+	{
+		mode += MODE_CONSTANT - MODE_IMMEDIATE;
+	}
+	return format == FORMAT_4 ? mode + MODE_EXTENDED : mode;
+}
+
+// Encodes a single resolved Format 3/4 instruction with a one-entry batch held on the stack, so callers that
+// encode one instruction at a time do not allocate
+// Returns false if the target is out of range or the immediate constant does not fit; otherwise, true
+bool encodeInstruction(int opcode, int mode, int target, int pc, int base, int* code)
+{
+	int opcodes[1], modes[1], targets[1], pcs[1], bases[1], codes[1];
+	instructionBatch single = { opcodes, modes, targets, pcs, bases, codes, 0, 1 };
+
+	addInstruction(&single, opcode, mode, target, pc, base);
+	if (encodeInstructions(&single) >= 0)
+	{
+		return false;
+	}
+	*code = codes[0];
+	return true;
+}
+
+// Encodes every instruction of the batch into its codes array
+// Each instruction is encoded with the same straight-line arithmetic so the loop can be vectorized
+// Returns the index of the first Format 3 instruction whose target is out of PC- and BASE-relative
+// range, or the first instruction whose immediate constant does not fit its address field; otherwise, -1
+int encodeInstructions(instructionBatch* batch)
+{
+	const int* opcodes = batch->opcodes;
+	const int* modes = batch->modes;
+	const int* targets = batch->targets;
+	const int* pcs = batch->pcs;
+	const int* bases = batch->bases;
+	int* codes = batch->codes;
+	int failed = 0;
+
+	for (int x = 0; x < batch->count; x++)
+	{
+		const addressingTemplate* mode = &addressingTemplates[modes[x]];
+		unsigned int first = (unsigned int)(opcodes[x] | mode->ni);
+		unsigned int target = (unsigned int)targets[x];
+		unsigned int constantLimit = mode->extended ? FORMAT_4_MAX_CONSTANT : FORMAT_3_MAX_CONSTANT;
+		int pcDisplacement = targets[x] - (pcs[x] + FORMAT_3);
+		int baseDisplacement = targets[x] - bases[x];
+		int usePc = pcDisplacement >= PC_MIN_RANGE && pcDisplacement < PC_MAX_RANGE;
+		int useBase = !usePc && baseDisplacement >= 0 && baseDisplacement < BASE_MAX_RANGE;
+		unsigned int displacement = (unsigned int)(usePc ? pcDisplacement : baseDisplacement) & 0xFFF;
+		unsigned int flags = mode->x | (usePc ? FLAG_P : 0) | (useBase ? FLAG_B : 0);
+
+		unsigned int relative = (first << 16) | (flags << 12) | displacement;
+		unsigned int constant = (first << 16) | (target & 0xFFF);
+		unsigned int extended = (first << 24) | ((mode->x | FLAG_E) << 20) | (target & 0xFFFFF);
+		unsigned int extendedConstant = (first << 24) | (FLAG_E << 20) | target;
+
+		codes[x] = (int)(mode->extended ? (mode->constant ? extendedConstant : extended)
+				: (mode->constant ? constant : relative));
+		failed |= !mode->extended && !mode->constant && !usePc && !useBase;
+		failed |= mode->constant && target > constantLimit;
+	}
+
+	if (!failed)
+	{
+		return -1;
+	}
+
+	// Only an instruction that will be reported as an error pays for finding its index
+	for (int x = 0; x < batch->count; x++)
+	{
+		const addressingTemplate* mode = &addressingTemplates[modes[x]];
+		unsigned int constantLimit = mode->extended ? FORMAT_4_MAX_CONSTANT : FORMAT_3_MAX_CONSTANT;
+
+		if ((!mode->extended && !mode->constant && !isFormat3Reachable(pcs[x], targets[x], bases[x])) ||
+				(mode->constant && (unsigned int)targets[x] > constantLimit))
+		{
+			return x;
+		}
+	}
+	return -1;
+}
+
+// Releases the arrays held by the batch
+void freeInstructionBatch(instructionBatch* batch)
+{
+	free(batch->opcodes);
+	free(batch->modes);
+	free(batch->targets);
+	free(batch->pcs);
+	free(batch->bases);
+	free(batch->codes);
+	memset(batch, 0, sizeof(instructionBatch));
+}
+
+// Do no modify any part of this function
+// Returns true if the provided string contains a numeric value; otherwise, false
+bool isNumeric(char* string)
+{
+	for(int x = 0; x < strlen(string); x++)
+	{
+		if(!isdigit(string[x])) return false;
+	}
+	return true;
+}
+
+// Returns true if the provided mode is an immediate numeric constant; otherwise, false
+bool isConstantMode(int mode)
+{
+	return addressingTemplates[mode].constant;
+}
+
+// Returns true if a Format 3 instruction at the provided address can reach the target address with
+// PC-relative or BASE-relative addressing; otherwise, false
+// --optimize decides formats with the same test that Pass 2 encodes with, so the two always agree
+bool isFormat3Reachable(int address, int targetAddress, int base)
+{
+	int pcDisplacement = targetAddress - (address + FORMAT_3);
+	int baseDisplacement = targetAddress - base;
+
+	return (pcDisplacement >= PC_MIN_RANGE && pcDisplacement < PC_MAX_RANGE) ||
+		(baseDisplacement >= 0 && baseDisplacement < BASE_MAX_RANGE);
+}
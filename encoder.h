@@ -0,0 +1,59 @@
+#pragma once
+
+#define BASE_MAX_RANGE 4096
+#define FLAG_B 0x04
+#define FLAG_E 0x01
+#define FLAG_P 0x02
+#define FLAG_X 0x08
+#define FORMAT_1 1
+#define FORMAT_2 2
+#define FORMAT_3 3
+#define FORMAT_3_MAX_CONSTANT 0xFFF
+#define FORMAT_4 4
+#define FORMAT_4_MAX_CONSTANT 0xFFFFF
+#define IMMEDIATE_CHARACTER '#'
+#define INDEX_STRING ",X"
+#define INDIRECT_CHARACTER '@'
+#define PC_MAX_RANGE 2048
+#define PC_MIN_RANGE -2048
+
+// List of addressing modes of a Format 3/4 operand
+// Indexed modes follow their base mode, and Format 4 modes follow all Format 3 modes
+enum addressingModes {
+	MODE_SIMPLE, MODE_SIMPLE_INDEXED,
+	MODE_IMMEDIATE, MODE_IMMEDIATE_INDEXED,
+	MODE_INDIRECT, MODE_INDIRECT_INDEXED,
+	MODE_CONSTANT, MODE_CONSTANT_INDEXED,
+	MODE_EXTENDED,                          // Added to a mode for a Format 4 instruction
+	MODE_COUNT = MODE_EXTENDED * 2
+};
+
+// Used to store the precomputed flags of an addressing mode
+typedef struct addressingTemplate {
+	int ni;           // n and i bits of the first byte
+	int x;            // x bit of the nixbpe nibble
+	bool extended;    // Format 4
+	bool constant;    // Immediate numeric operand, encoded without relative addressing
+} addressingTemplate;
+
+// Used to store already-resolved Format 3/4 instructions for batch encoding
+// Each field is a separate array so the encoding loop reads contiguous values
+typedef struct instructionBatch {
+	int* opcodes;     // Opcode value with the n and i bits clear
+	int* modes;       // Index into the addressing mode templates
+	int* targets;     // Target address, or the value of an immediate constant
+	int* pcs;         // Address of the instruction
+	int* bases;       // BASE register value in effect for the instruction
+	int* codes;       // Encoded object code
+	int count;
+	int capacity;
+} instructionBatch;
+
+void addInstruction(instructionBatch* batch, int opcode, int mode, int target, int pc, int base);
+int classifyAddressing(char* operand, int format, char* symbolName);
+bool encodeInstruction(int opcode, int mode, int target, int pc, int base, int* code);
+int encodeInstructions(instructionBatch* batch);
+void freeInstructionBatch(instructionBatch* batch);
+bool isConstantMode(int mode);
+bool isFormat3Reachable(int address, int targetAddress, int base);
+bool isNumeric(char* string);
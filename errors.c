@@ -7,61 +7,147 @@
  *        DO NOT REMOVE THIS MESSAGE
  **********************************************/
 
-#include "headers.h"
+#include "assembler.h"
+
+// Each thread of a pipelined assembly reports the location of the line it is working on
+_Thread_local jmp_buf* errorRecovery = NULL;
+_Thread_local char* errorFilename = NULL;
+_Thread_local int errorLineNumber = 0;
+_Thread_local errorReport* errorCapture = NULL;
 
-// Do no modify any part of this function
 // Displays the specified error along with the provided error information
+// The error is prefixed with the file and line of the source line being assembled, if any
+// When a capture is set, the message and location are stored in it rather than displayed
+// When a recovery point is set, control returns there instead of to the caller
 void displayError(int errorType, char* errorInfo)
 {
+	FILE* output = stdout;
+
+	if (errorCapture != NULL)
+	{
+		memset(errorCapture, 0, sizeof(errorReport));
+		errorCapture->errorType = errorType;
+		errorCapture->filename = errorFilename;
+		errorCapture->lineNumber = errorLineNumber;
+		output = fmemopen(errorCapture->message, ERROR_MESSAGE_SIZE - 1, "w");
+	}
+	else if (errorFilename != NULL)
+	{
+		fprintf(output, "%s:%d: ", errorFilename, errorLineNumber);
+	}
+
 	// Determine which error message to display
 	switch (errorType)
 	{
 	// Pass 1 errors
 	// Blank line found
 	case BLANK_RECORD:
-		printf("ERROR: Source File Contains Blank Lines.\n");
+		fprintf(output, "ERROR: Source File Contains Blank Lines.\n");
+		break;
+		// Two command-line options, or an option and the number of input files, cannot be used together
+	case CONFLICTING_OPTIONS:
+		fprintf(output, "ERROR: Options Cannot be Combined (%s).\n", errorInfo);
 		break;
 		// The symbol name already exists in the Symbol Table
 	case DUPLICATE:
-		printf("ERROR: Duplicate Symbol Name (%s) Found in Source File.\n", errorInfo);
+		fprintf(output, "ERROR: Duplicate Symbol Name (%s) Found in Source File.\n", errorInfo);
 		break;
 		// The provided file was not found
 	case FILE_NOT_FOUND:
-		printf("FATAL ERROR: File Not Found (%s).\n", errorInfo);
+		fprintf(output, "FATAL ERROR: File Not Found (%s).\n", errorInfo);
+		break;
+		// An IF/ELSE/ENDIF is unbalanced, has a label or an empty condition, or nests too deeply
+	case ILLEGAL_CONDITION:
+		fprintf(output, "ERROR: Illegal Conditional Assembly (%s) Found in Source File.\n", errorInfo);
+		break;
+		// A file read by the assembler does not have the expected layout
+	case ILLEGAL_FILE_FORMAT:
+		fprintf(output, "ERROR: Illegal File Format (%s).\n", errorInfo);
+		break;
+		// An INCLUDE has no file name, includes a file that is already being read, or nests too deeply
+	case ILLEGAL_INCLUDE:
+		fprintf(output, "ERROR: Illegal INCLUDE (%s) Found in Source File.\n", errorInfo);
+		break;
+		// A MACRO/MEND definition is malformed or a macro expansion cannot be performed
+	case ILLEGAL_MACRO:
+		fprintf(output, "ERROR: Illegal Macro Definition or Expansion (%s) Found in Source File.\n", errorInfo);
 		break;
 		// An unknown opcode or directive name exists in the Operation segment of an instruction
 	case ILLEGAL_OPCODE_DIRECTIVE:
-		printf("ERROR: Illegal Opcode or Directive (%s) Found in Source File.\n", errorInfo);
+		fprintf(output, "ERROR: Illegal Opcode or Directive (%s) Found in Source File.\n", errorInfo);
 		break;
 		// An opcode or directive name exists in the Label segment of an instruction
 	case ILLEGAL_SYMBOL:
-		printf("ERROR: Symbol Name (%s) Cannot be a Command or Directive.\n", errorInfo);
+		fprintf(output, "ERROR: Symbol Name (%s) Cannot be a Command or Directive.\n", errorInfo);
+		break;
+		// A macro invocation does not supply one argument per macro parameter
+	case MACRO_ARGUMENT_COUNT:
+		fprintf(output, "ERROR: Wrong Number of Arguments for Macro (%s).\n", errorInfo);
+		break;
+		// The memory use of a bounded-memory assembly exceeds, or cannot be kept within, the --max-memory limit
+	case MEMORY_LIMIT:
+		fprintf(output, "ERROR: Memory Use (%s) Exceeds the --max-memory Limit.\n", errorInfo);
 		break;
 		// The input filename was not provided as a command-line argument
 	case MISSING_COMMAND_LINE_ARGUMENTS:
-		printf("Usage: %s inputFile\n", errorInfo);
+		fprintf(output, "Usage: %s [--optimize] [--analyze] [--strip-unused] [--no-listing | --listing-sidecar | --render-listing] [--debug-info] [--symbols] [--watch] [--disassemble | --load | --translate | --bench | --bench-json | --check] [--pack N] [--delta previous.obj] [--cache-dir DIR [--cache-size SIZE]] [--async-io] [--pipeline | --max-memory SIZE] inputFile...\n", errorInfo);
 		break;
 		// The current memory value exceeds the maximum SIC/XE memory (0x100000)
 	case OUT_OF_MEMORY:
-		printf("ERROR: Program Address (%s) Exceeds Maximum Memory Address [0x100000].\n", errorInfo);
+		fprintf(output, "ERROR: Program Address (%s) Exceeds Maximum Memory Address [0x100000].\n", errorInfo);
 		break;
 		// The specified BYTE value exceeds the valid range of 00 to FF
 	case OUT_OF_RANGE_BYTE:
-		printf("ERROR: Byte Value (%s) Out of Range [00 to FF].\n", errorInfo);
+		fprintf(output, "ERROR: Byte Value (%s) Out of Range [00 to FF].\n", errorInfo);
+		break;
+		// An output file written behind the assembly could not be written
+	case WRITE_FAILED:
+		fprintf(output, "FATAL ERROR: Could Not Write File (%s).\n", errorInfo);
 		break;
 
 		// Pass 2 errors
-		// Format 3 opcode, but PC- and BASE-relative addressing is out of range
+		// Format 3 opcode, but PC- and BASE-relative addressing is out of range, or an immediate constant does not fit
 	case ADDRESS_OUT_OF_RANGE:
-		printf("ERROR: Format 3 Opcode (%s) Address Displacement Out of Range [-2,048 to 4,096].\n", errorInfo);
+		fprintf(output, "ERROR: Format 3 Opcode (%s) Address Displacement Out of Range [-2,048 to 4,096].\n", errorInfo);
 		break;
 		// Format 4 is indicated for a Format 1 or Format 2 opcode
 	case ILLEGAL_OPCODE_FORMAT:
-		printf("ERROR: Format 4 Indicated (%s) for Other Than Format 3 Opcode.\n", errorInfo);
+		fprintf(output, "ERROR: Format 4 Indicated (%s) for Other Than Format 3 Opcode.\n", errorInfo);
 		break;
 		// The specified operand name is not found in the Symbol Table
 	case UNKNOWN_SYMBOL:
-		printf("ERROR: Unknown Operand Symbol (%s).\n", errorInfo);
+		fprintf(output, "ERROR: Unknown Operand Symbol (%s).\n", errorInfo);
 		break;
 	}
+
+	if (errorCapture != NULL)
+	{
+		fclose(output);
+		errorCapture->message[strcspn(errorCapture->message, "\n")] = '\0';
+	}
+	if (errorRecovery != NULL)
+	{
+		longjmp(*errorRecovery, errorType);
+	}
+}
+
+// Makes displayError store each error in the provided report; NULL displays errors again
+// --check uses this to turn errors into diagnostics
+void setErrorCapture(errorReport* capture)
+{
+	errorCapture = capture;
+}
+
+// Sets the source location reported with errors; a NULL filename stops reporting a location
+void setErrorLocation(char* filename, int lineNumber)
+{
+	errorFilename = filename;
+	errorLineNumber = lineNumber;
+}
+
+// Makes displayError return to the provided recovery point instead of to its caller
+// Watch mode uses this so an error in an edited source does not end the watch
+void setErrorRecovery(jmp_buf* recovery)
+{
+	errorRecovery = recovery;
 }
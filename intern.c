@@ -0,0 +1,123 @@
+#include "assembler.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+unsigned int computeNameHash(char* name);
+int findSlot(char* name, unsigned int hash);
+char** getNameEntry(int id);
+void growSlots(void);
+
+// The names of the whole run share one pool, so an ID stays valid across watch mode rebuilds
+internPool names = { 0 };
+
+// Compute an FNV-1a hash value for the provided name
+unsigned int computeNameHash(char* name)
+{
+	unsigned int hash = FNV_OFFSET_BASIS;
+
+	for (int x = 0; name[x] != '\0'; x++)
+	{
+		hash = (hash ^ (unsigned char)name[x]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+// Returns the ID of the provided name; otherwise, NO_NAME (the name was never interned)
+int findName(char* name)
+{
+	if (names.slotCount == 0)
+	{
+		return NO_NAME;
+	}
+	return names.slots[findSlot(name, computeNameHash(name))];
+}
+
+// Returns the index of the slot that holds the name, or of the empty slot where it belongs
+int findSlot(char* name, unsigned int hash)
+{
+	int mask = names.slotCount - 1;
+	int slot = hash & mask;
+
+	while (names.slots[slot] != NO_NAME)
+	{
+		int id = names.slots[slot];
+		if (names.hashes[id] == hash && strcmp(*getNameEntry(id), name) == 0)
+		{
+			break;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+// Returns the name with the provided ID
+char* getName(int id)
+{
+	return id == NO_NAME ? "" : *getNameEntry(id);
+}
+
+// Returns where the name with the provided ID is stored
+char** getNameEntry(int id)
+{
+	return &names.blocks[id / INTERN_BLOCK_SIZE][id % INTERN_BLOCK_SIZE];
+}
+
+// Doubles the slots of the pool and places every ID again
+void growSlots(void)
+{
+	names.slotCount = names.slotCount ? names.slotCount * 2 : INTERN_INITIAL_SLOTS;
+	names.slots = (int*)realloc(names.slots, sizeof(int) * names.slotCount);
+	for (int x = 0; x < names.slotCount; x++)
+	{
+		names.slots[x] = NO_NAME;
+	}
+
+	for (int id = 0; id < names.count; id++)
+	{
+		int slot = names.hashes[id] & (names.slotCount - 1);
+		while (names.slots[slot] != NO_NAME)
+		{
+			slot = (slot + 1) & (names.slotCount - 1);
+		}
+		names.slots[slot] = id;
+	}
+}
+
+// Returns the ID of the provided name, giving the name the next ID the first time it is seen
+int internName(char* name)
+{
+	unsigned int hash = computeNameHash(name);
+	int slot;
+
+	// Keep the slots at most half full so probe sequences stay short
+	if (names.count * 2 >= names.slotCount)
+	{
+		growSlots();
+	}
+
+	slot = findSlot(name, hash);
+	if (names.slots[slot] != NO_NAME)
+	{
+		return names.slots[slot];
+	}
+
+	if (names.count == names.capacity)
+	{
+		names.capacity = names.capacity ? names.capacity * 2 : INTERN_INITIAL_SLOTS;
+		names.hashes = (unsigned int*)realloc(names.hashes, sizeof(unsigned int) * names.capacity);
+	}
+	if (names.count % INTERN_BLOCK_SIZE == 0)
+	{
+		if (names.count / INTERN_BLOCK_SIZE == INTERN_BLOCK_COUNT)
+		{
+			displayError(OUT_OF_MEMORY, name);
+			exit(-1);
+		}
+		names.blocks[names.count / INTERN_BLOCK_SIZE] = (char**)malloc(sizeof(char*) * INTERN_BLOCK_SIZE);
+	}
+	*getNameEntry(names.count) = strdup(name);
+	names.hashes[names.count] = hash;
+	names.slots[slot] = names.count;
+	return names.count++;
+}
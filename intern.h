@@ -0,0 +1,23 @@
+#pragma once
+
+#define INTERN_BLOCK_COUNT 1024
+#define INTERN_BLOCK_SIZE 4096
+#define INTERN_INITIAL_SLOTS 256
+#define NO_NAME -1
+
+// Used to give each distinct label, symbol and mnemonic of a run a dense integer ID
+// Names are looked up once when a line is lexed; later comparisons use the IDs
+// Names are kept in blocks that never move, so a pipeline stage can read the name of an ID it was
+// handed while the lexer thread keeps adding names
+typedef struct internPool {
+	char** blocks[INTERN_BLOCK_COUNT]; // Names indexed by ID, INTERN_BLOCK_SIZE per block
+	unsigned int* hashes;    // Indexed by ID, so the slots can grow without hashing the names again
+	int count;
+	int capacity;            // IDs the hashes have room for
+	int* slots;              // Open-addressing table of IDs; NO_NAME when empty
+	int slotCount;           // Power of two
+} internPool;
+
+int findName(char* name);
+char* getName(int id);
+int internName(char* name);
@@ -0,0 +1,149 @@
+#include "assembler.h"
+
+// Closes the file used by the listing, if any
+void closeListing(listing* output)
+{
+	if (output->file != NULL)
+	{
+		fclose(output->file);
+		output->file = NULL;
+	}
+}
+
+// Opens the .lst file or the .lsx sidecar that Pass 2 writes its listing to
+void openListing(listing* output, char* filename, char* sourceName, int mode, pipeline* stages)
+{
+	output->mode = mode;
+	output->file = NULL;
+	output->firstLine = 0;
+
+	if (mode == LISTING_NONE)
+	{
+		return;
+	}
+
+	output->file = openOutputFile(filename, mode == LISTING_SIDECAR ? "wb" : "w", stages);
+	if (!output->file)
+	{
+		displayError(FILE_NOT_FOUND, filename);
+		exit(-1);
+	}
+	if (mode == LISTING_SIDECAR)
+	{
+		unsigned long long sourceHash = hashSourceFiles(sourceName, getIncludeRecord());
+
+		fwrite(LISTING_MAGIC, 1, LISTING_MAGIC_SIZE, output->file);
+		fwrite(&sourceHash, sizeof(sourceHash), 1, output->file);
+	}
+}
+
+// Writes the .lst file described by the .lsx sidecar records and the source line stream
+// The line stream must have just been read, so the files it included are those of the current include record
+void renderListing(char* sidecarName, char* sourceName, char* listingName, lineStream* lines)
+{
+	char magic[LISTING_MAGIC_SIZE];
+	unsigned long long sourceHash;
+	listingRecord record;
+	FILE* sidecar = fopen(sidecarName, "rb");
+	FILE* file;
+
+	if (!sidecar)
+	{
+		displayError(FILE_NOT_FOUND, sidecarName);
+		exit(-1);
+	}
+	if (fread(magic, 1, LISTING_MAGIC_SIZE, sidecar) != LISTING_MAGIC_SIZE ||
+			memcmp(magic, LISTING_MAGIC, LISTING_MAGIC_SIZE) != 0 ||
+			fread(&sourceHash, sizeof(sourceHash), 1, sidecar) != 1 ||
+			sourceHash != hashSourceFiles(sourceName, getIncludeRecord()))
+	{
+		displayError(ILLEGAL_FILE_FORMAT, sidecarName);
+		exit(-1);
+	}
+
+	file = fopen(listingName, "w");
+	if (!file)
+	{
+		displayError(FILE_NOT_FOUND, listingName);
+		exit(-1);
+	}
+
+	while (fread(&record, sizeof(listingRecord), 1, sidecar) == 1)
+	{
+		segment segments;
+
+		// Only a damaged sidecar can name a line the source does not have
+		if (record.line < 0 || record.line >= lines->count)
+		{
+			displayError(ILLEGAL_FILE_FORMAT, sidecarName);
+			exit(-1);
+		}
+
+		segments = lines->lines[record.line].segments;
+		if (record.flags & LISTING_EXTENDED)
+		{
+			memmove(&segments.operation[1], segments.operation, SEGMENT_SIZE - 1);
+			segments.operation[0] = '+';
+		}
+		else if ((record.flags & LISTING_SHORTENED) && segments.operation[0] == '+')
+		{
+			memmove(segments.operation, &segments.operation[1], SEGMENT_SIZE - 1);
+		}
+		writeToLstFile(file, record.address, &segments, record.code);
+	}
+
+	fclose(sidecar);
+	fclose(file);
+}
+
+// Adds a line to the listing in the format selected when the listing was opened
+void writeListingLine(listing* output, int address, lineStream* lines, int lineIndex, int code)
+{
+	sourceLine* line = &lines->lines[lineIndex];
+
+	if (output->mode == LISTING_TEXT)
+	{
+		writeToLstFile(output->file, address, &line->segments, code);
+	}
+	else if (output->mode == LISTING_SIDECAR)
+	{
+		int flags = !line->relaxed ? 0 : line->segments.operation[0] == '+' ? LISTING_EXTENDED : LISTING_SHORTENED;
+		listingRecord record = { address, code, output->firstLine + lineIndex, flags };
+		fwrite(&record, sizeof(listingRecord), 1, output->file);
+	}
+}
+
+// Do no modify any part of this function
+// Write SIC/XE instructions along with address and object code information of source code listing file
+void writeToLstFile(FILE* file, int address, segment* segments, int opcode)
+{
+	char ctrlString[27];
+	int length;
+
+	int directiveType = isDirective(segments->operation);
+
+	if (isStartDirective(directiveType) ||
+			isBaseDirective(directiveType) ||
+			isReserveDirective(directiveType))
+	{
+		fprintf(file, "%-8X%-8s%-8s%-11s\n", address, segments->label, segments->operation, segments->operand);
+	}
+	else if (isEndDirective(directiveType))
+	{
+		fprintf(file, "%-8X%-8s%-8s%-11s", address, segments->label, segments->operation, segments->operand);
+	}
+	else
+	{
+		if (isDataDirective(directiveType))
+		{
+			length = getMemoryAmount(directiveType, segments->operand) * 2;
+		}
+		else
+		{
+			length = getOpcodeFormat(segments->operation) * 2;
+		}
+		sprintf(ctrlString, "%%-8X%%-8s%%-8s%%-11s %%0%dX\n", length);
+
+		fprintf(file, ctrlString, address, segments->label, segments->operation, segments->operand, opcode);
+	}
+}
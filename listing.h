@@ -0,0 +1,36 @@
+#pragma once
+
+#define LISTING_EXTENDED 0x01
+#define LISTING_SHORTENED 0x02
+#define LISTING_MAGIC "SICL"
+#define LISTING_MAGIC_SIZE 4
+
+// List of ways the source code listing can be produced
+enum listingModes {
+	LISTING_TEXT,     // Write the .lst file during Pass 2
+	LISTING_NONE,     // Skip all listing work
+	LISTING_SIDECAR   // Write compact .lsx records that can be rendered into the .lst later
+};
+
+// The .lsx sidecar starts with LISTING_MAGIC and the hashSourceFiles hash of the source and its included files,
+// so a sidecar is never rendered against sources that changed after it was written
+// Used to store a single line of the listing in the compact .lsx sidecar
+typedef struct listingRecord {
+	int address;
+	int code;
+	int line;         // Index of the line in the line stream
+	int flags;        // LISTING_EXTENDED or LISTING_SHORTENED when --optimize added or dropped the '+'
+} listingRecord;
+
+// Used to manage the listing output of Pass 2
+typedef struct listing {
+	int mode;
+	FILE* file;
+	int firstLine;    // Line stream index of the first line of the lines being written
+} listing;
+
+void closeListing(listing* output);
+void openListing(listing* output, char* filename, char* sourceName, int mode, pipeline* stages);
+void renderListing(char* sidecarName, char* sourceName, char* listingName, lineStream* lines);
+void writeListingLine(listing* output, int address, lineStream* lines, int lineIndex, int code);
+void writeToLstFile(FILE* file, int address, segment* segments, int opcode);
@@ -0,0 +1,371 @@
+#include "assembler.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define ADDRESS_FIELD_SIZE 6
+#define END_RECORD_LENGTH 7     // Characters of an End or Header record without its line terminator
+#define HEADER_RECORD_LENGTH 19
+#define LOCATION_SIZE 300
+#define TEXT_RECORD_DATA 9
+
+void allocateMemoryImage(memoryImage* image);
+bool decodeHexScalar(unsigned char* destination, char* text, int count);
+int getHexValue(char character);
+bool isObjectFile(char* text, size_t size);
+void loadRecords(char* text, size_t size, memoryImage* image, char* filename);
+char* mapInputFile(char* filename, size_t* size);
+void markLoaded(memoryImage* image, int address, int count);
+int readHexField(char* text, int length);
+void reportIllegalRecord(char* filename, int recordNumber);
+
+#ifdef __SSE2__
+bool decodeHexLanes(char* text, __m128i* lanes);
+#endif
+
+// Maps both halves of the image to anonymous zero pages
+void allocateMemoryImage(memoryImage* image)
+{
+	memset(image, 0, sizeof(memoryImage));
+	image->bytes = (unsigned char*)mmap(NULL, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	image->loaded = (unsigned char*)mmap(NULL, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+}
+
+// Converts pairs of hex characters into bytes, 32 characters at a time when SSE2 is available
+// Returns true if every character is a hex digit; otherwise, false
+bool decodeHex(unsigned char* destination, char* text, int count)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	__m128i first, second;
+
+	for (; x + 16 <= count; x += 16)
+	{
+		if (!(decodeHexLanes(&text[x * 2], &first) & decodeHexLanes(&text[x * 2 + 16], &second)))
+		{
+			return false;
+		}
+		_mm_storeu_si128((__m128i*)&destination[x], _mm_packus_epi16(first, second));
+	}
+	if (x + 8 <= count)
+	{
+		if (!decodeHexLanes(&text[x * 2], &first))
+		{
+			return false;
+		}
+		_mm_storel_epi64((__m128i*)&destination[x], _mm_packus_epi16(first, first));
+		x += 8;
+	}
+#endif
+
+	return decodeHexScalar(&destination[x], &text[x * 2], count - x);
+}
+
+#ifdef __SSE2__
+// Converts 16 hex characters into 8 byte values, one in the low half of each 16-bit lane
+// Returns true if every character is a hex digit; otherwise, false
+bool decodeHexLanes(char* text, __m128i* lanes)
+{
+	__m128i characters = _mm_loadu_si128((__m128i*)text);
+	__m128i lower = _mm_or_si128(characters, _mm_set1_epi8(0x20));
+
+	// Characters above 0x7F compare as negative, so they are never digits or letters
+	__m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(characters, _mm_set1_epi8('0' - 1)),
+			_mm_cmplt_epi8(characters, _mm_set1_epi8('9' + 1)));
+	__m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+			_mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+	__m128i nibbles = _mm_or_si128(_mm_and_si128(isDigit, _mm_sub_epi8(characters, _mm_set1_epi8('0'))),
+			_mm_and_si128(isLetter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+
+	// The first character of each pair is the high nibble of the byte
+	*lanes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4),
+			_mm_srli_epi16(nibbles, 8));
+	return _mm_movemask_epi8(_mm_or_si128(isDigit, isLetter)) == 0xFFFF;
+}
+#endif
+
+// Converts pairs of hex characters into bytes one character at a time
+// Returns true if every character is a hex digit; otherwise, false
+bool decodeHexScalar(unsigned char* destination, char* text, int count)
+{
+	for (int x = 0; x < count; x++)
+	{
+		int high = getHexValue(text[x * 2]);
+		int low = getHexValue(text[x * 2 + 1]);
+		if ((high | low) < 0)
+		{
+			return false;
+		}
+		destination[x] = (high << 4) | low;
+	}
+	return true;
+}
+
+// Prints the program and how much of SIC/XE memory it occupies
+void displayMemoryImage(memoryImage* image)
+{
+	int pageCount = 0;
+
+	for (int x = 0; x < MEMORY_PAGE_COUNT; x++)
+	{
+		pageCount += image->pages[x];
+	}
+	printf("Program:  %-6s  Start: %06X  Length: %06X  Entry: %06X\n",
+			image->name, image->start, image->end - image->start, image->entry);
+	printf("Loaded:   %d bytes in %d of %d pages\n", image->loadedBytes, pageCount, MEMORY_PAGE_COUNT);
+}
+
+// Releases the memory held by the image
+void freeMemoryImage(memoryImage* image)
+{
+	munmap(image->bytes, MEMORY_SIZE);
+	munmap(image->loaded, MEMORY_SIZE);
+	image->bytes = NULL;
+	image->loaded = NULL;
+}
+
+// Returns the value of a hex digit; otherwise, -1
+int getHexValue(char character)
+{
+	if (character >= '0' && character <= '9')
+	{
+		return character - '0';
+	}
+	else if (character >= 'A' && character <= 'F')
+	{
+		return character - 'A' + 10;
+	}
+	else if (character >= 'a' && character <= 'f')
+	{
+		return character - 'a' + 10;
+	}
+	return -1;
+}
+
+// Returns true if the text starts with a Header record; otherwise, false
+bool isObjectFile(char* text, size_t size)
+{
+	return size >= HEADER_RECORD_LENGTH && text[0] == 'H' &&
+			readHexField(&text[NAME_SIZE], ADDRESS_FIELD_SIZE) >= 0 &&
+			readHexField(&text[NAME_SIZE + ADDRESS_FIELD_SIZE], ADDRESS_FIELD_SIZE) >= 0;
+}
+
+// Loads a .obj file into SIC/XE memory; any other file is loaded as a raw memory image at address 0
+void loadMemoryImage(char* filename, memoryImage* image)
+{
+	size_t size;
+	char* text = mapInputFile(filename, &size);
+
+	allocateMemoryImage(image);
+	if (isObjectFile(text, size))
+	{
+		loadRecords(text, size, image, filename);
+	}
+	else
+	{
+		if (size > MEMORY_SIZE)
+		{
+			displayError(OUT_OF_MEMORY, filename);
+			exit(-1);
+		}
+		memcpy(image->bytes, text, size);
+		markLoaded(image, 0, size);
+		image->end = size;
+	}
+
+	if (text != NULL)
+	{
+		munmap(text, size);
+	}
+}
+
+// Loads a .obj file into SIC/XE memory
+void loadObjectFile(char* filename, memoryImage* image)
+{
+	size_t size;
+	char* text = mapInputFile(filename, &size);
+
+	allocateMemoryImage(image);
+	if (!isObjectFile(text, size))
+	{
+		reportIllegalRecord(filename, 1);
+	}
+	loadRecords(text, size, image, filename);
+	munmap(text, size);
+}
+
+// Validates every record of a .obj file and copies the Text record bytes into the image
+// The file must have one Header record, then Text and Modification records, then one End record
+void loadRecords(char* text, size_t size, memoryImage* image, char* filename)
+{
+	char* end = text + size;
+	char* record = text;
+	int recordNumber = 0;
+	bool ended = false;
+
+	while (record < end)
+	{
+		char* next = memchr(record, '\n', end - record);
+		int length = (next ? next : end) - record;
+		next = next ? next + 1 : end;
+		recordNumber++;
+
+		if (length > 0 && record[length - 1] == '\r')
+		{
+			length--;
+		}
+		if (length == 0)
+		{
+			record = next;
+			continue;
+		}
+		if (ended)
+		{
+			reportIllegalRecord(filename, recordNumber);
+		}
+
+		// The length of each record is checked before any of its fixed-column fields is read
+		if (record[0] == 'H')
+		{
+			if (recordNumber != 1 || length != HEADER_RECORD_LENGTH)
+			{
+				reportIllegalRecord(filename, recordNumber);
+			}
+
+			int programSize = readHexField(&record[NAME_SIZE + ADDRESS_FIELD_SIZE], ADDRESS_FIELD_SIZE);
+			image->start = image->entry = readHexField(&record[NAME_SIZE], ADDRESS_FIELD_SIZE);
+			image->end = image->start + programSize;
+			if (image->start < 0 || programSize < 0 || image->end > MEMORY_SIZE)
+			{
+				reportIllegalRecord(filename, recordNumber);
+			}
+
+			memcpy(image->name, &record[1], NAME_SIZE - 1);
+			for (int x = NAME_SIZE - 2; x >= 0 && image->name[x] == ' '; x--)
+			{
+				image->name[x] = '\0';
+			}
+		}
+		else if (record[0] == 'T')
+		{
+			if (length < TEXT_RECORD_DATA)
+			{
+				reportIllegalRecord(filename, recordNumber);
+			}
+
+			int recordAddress = readHexField(&record[1], ADDRESS_FIELD_SIZE);
+			int byteCount = readHexField(&record[1 + ADDRESS_FIELD_SIZE], 2);
+			if (recordAddress < image->start || byteCount < 0 || length != TEXT_RECORD_DATA + byteCount * 2 ||
+					recordAddress + byteCount > image->end ||
+					!decodeHex(&image->bytes[recordAddress], &record[TEXT_RECORD_DATA], byteCount))
+			{
+				reportIllegalRecord(filename, recordNumber);
+			}
+			markLoaded(image, recordAddress, byteCount);
+		}
+		else if (record[0] == 'M')
+		{
+			// Modification records do not change an image loaded at its assembled address
+			if (length < TEXT_RECORD_DATA || readHexField(&record[1], ADDRESS_FIELD_SIZE) < 0 ||
+					readHexField(&record[1 + ADDRESS_FIELD_SIZE], 2) < 0)
+			{
+				reportIllegalRecord(filename, recordNumber);
+			}
+		}
+		else if (record[0] == 'E')
+		{
+			if (length != END_RECORD_LENGTH || (image->entry = readHexField(&record[1], ADDRESS_FIELD_SIZE)) < 0)
+			{
+				reportIllegalRecord(filename, recordNumber);
+			}
+			ended = true;
+		}
+		else
+		{
+			reportIllegalRecord(filename, recordNumber);
+		}
+		record = next;
+	}
+
+	if (!ended)
+	{
+		reportIllegalRecord(filename, recordNumber + 1);
+	}
+}
+
+// Maps the input file read-only
+// Returns the contents of the file; otherwise, NULL (the file is empty)
+char* mapInputFile(char* filename, size_t* size)
+{
+	struct stat status;
+	char* text = NULL;
+	int file = open(filename, O_RDONLY);
+
+	if (file < 0)
+	{
+		displayError(FILE_NOT_FOUND, filename);
+		exit(-1);
+	}
+
+	fstat(file, &status);
+	*size = status.st_size;
+	if (*size > 0)
+	{
+		text = (char*)mmap(NULL, *size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (text == MAP_FAILED)
+		{
+			displayError(FILE_NOT_FOUND, filename);
+			exit(-1);
+		}
+	}
+	close(file);
+	return text;
+}
+
+// Records that the provided range of the image holds loaded bytes
+void markLoaded(memoryImage* image, int address, int count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	memset(&image->loaded[address], 1, count);
+	for (int x = address / MEMORY_PAGE_SIZE; x <= (address + count - 1) / MEMORY_PAGE_SIZE; x++)
+	{
+		image->pages[x] = true;
+	}
+	image->loadedBytes += count;
+}
+
+// Converts a fixed-width hexadecimal field of a record
+// Returns the value of the field; otherwise, -1 (the field contains a non-hex character)
+int readHexField(char* text, int length)
+{
+	int value = 0;
+
+	for (int x = 0; x < length; x++)
+	{
+		int digit = getHexValue(text[x]);
+		if (digit < 0)
+		{
+			return -1;
+		}
+		value = (value << 4) | digit;
+	}
+	return value;
+}
+
+// Reports a record of a .obj file that cannot be loaded
+void reportIllegalRecord(char* filename, int recordNumber)
+{
+	char location[LOCATION_SIZE];
+
+	snprintf(location, LOCATION_SIZE, "%s, record %d", filename, recordNumber);
+	displayError(ILLEGAL_FILE_FORMAT, location);
+	exit(-1);
+}
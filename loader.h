@@ -0,0 +1,24 @@
+#pragma once
+
+#define MEMORY_PAGE_COUNT (MEMORY_SIZE / MEMORY_PAGE_SIZE)
+#define MEMORY_PAGE_SIZE 0x1000
+#define MEMORY_SIZE 0x100000
+
+// Used to store a program loaded from a .obj file or a raw memory image
+// Both maps are anonymous mappings, so pages that no Text record writes stay unbacked zero pages
+typedef struct memoryImage {
+	unsigned char* bytes;                // MEMORY_SIZE bytes of SIC/XE memory
+	unsigned char* loaded;               // 1 for each byte supplied by the input; gaps are RESB/RESW areas
+	bool pages[MEMORY_PAGE_COUNT];       // Pages written by at least one Text record
+	char name[NAME_SIZE];
+	int start;
+	int end;                             // First address after the program
+	int entry;                           // Execution address from the End record
+	int loadedBytes;
+} memoryImage;
+
+bool decodeHex(unsigned char* destination, char* text, int count);
+void displayMemoryImage(memoryImage* image);
+void freeMemoryImage(memoryImage* image);
+void loadMemoryImage(char* filename, memoryImage* image);
+void loadObjectFile(char* filename, memoryImage* image);
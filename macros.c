@@ -0,0 +1,317 @@
+#include "assembler.h"
+
+#define ARGUMENT_SEPARATOR ','
+#define EXPANSION_ID_DIGITS 2
+#define EXPANSION_ID_RADIX 36
+#define PARAMETER_CHARACTER '&'
+#define SINGLE_QUOTE 39
+
+int computeExpansionHash(int macroIndex, char* arguments);
+bool hasLocalLabel(segment* line);
+void insertExpansionId(char field[], int expansionId);
+int splitArguments(char* string, char values[][SEGMENT_SIZE], int maxValues, char* errorInfo);
+void substituteParameters(char field[], macroDefinition* definition, char arguments[][SEGMENT_SIZE]);
+
+// Appends a lexed body line to the specified macro definition
+void addMacroLine(macroTable* table, int macroIndex, segment* line)
+{
+	macroDefinition* definition = &table->definitions[macroIndex];
+
+	if (definition->bodyCount == definition->bodyCapacity)
+	{
+		definition->bodyCapacity = definition->bodyCapacity ? definition->bodyCapacity * 2 : 8;
+		definition->body = (segment*)realloc(definition->body, sizeof(segment) * definition->bodyCapacity);
+	}
+	definition->body[definition->bodyCount++] = *line;
+
+	if (hasLocalLabel(line))
+	{
+		definition->hasLocalLabels = true;
+	}
+}
+
+// Compute a hash value for the provided (macro, argument tuple) pair
+int computeExpansionHash(int macroIndex, char* arguments)
+{
+	unsigned int hash = (unsigned int)macroIndex;
+
+	for (int x = 0; arguments[x] != '\0'; x++)
+	{
+		hash = hash * 31 + (unsigned char)arguments[x];
+	}
+	return hash % MACRO_CACHE_SIZE;
+}
+
+// Adds a new macro to the definition table
+// Returns the index of the new definition
+int defineMacro(macroTable* table, char* name, char* parameters)
+{
+	macroDefinition* definition;
+
+	if (isDirective(name) || isOpcode(name))
+	{
+		displayError(ILLEGAL_SYMBOL, name);
+		exit(-1);
+	}
+	if (findMacro(table, name) >= 0)
+	{
+		displayError(DUPLICATE, name);
+		exit(-1);
+	}
+
+	if (table->definitionCount == table->definitionCapacity)
+	{
+		table->definitionCapacity = table->definitionCapacity ? table->definitionCapacity * 2 : 8;
+		table->definitions = (macroDefinition*)realloc(table->definitions, sizeof(macroDefinition) * table->definitionCapacity);
+	}
+	definition = &table->definitions[table->definitionCount];
+	memset(definition, 0, sizeof(macroDefinition));
+	strcpy(definition->name, name);
+
+	definition->parameterCount = splitArguments(parameters, definition->parameters, MAX_MACRO_PARAMETERS, name);
+	for (int x = 0; x < definition->parameterCount; x++)
+	{
+		if (definition->parameters[x][0] != PARAMETER_CHARACTER)
+		{
+			displayError(ILLEGAL_MACRO, definition->parameters[x]);
+			exit(-1);
+		}
+	}
+	return table->definitionCount++;
+}
+
+// Returns the cached expansion of the macro for the provided arguments, substituting the
+// parameters of each body line the first time a given argument tuple is seen
+macroExpansion* expandMacro(macroTable* table, int macroIndex, char* arguments)
+{
+	macroDefinition* definition = &table->definitions[macroIndex];
+	char values[MAX_MACRO_PARAMETERS][SEGMENT_SIZE];
+	int hashIndex = computeExpansionHash(macroIndex, arguments);
+	macroExpansion* expansion;
+
+	for (expansion = table->expansions[hashIndex]; expansion != NULL; expansion = expansion->next)
+	{
+		if (expansion->macroIndex == macroIndex && strcmp(expansion->arguments, arguments) == 0)
+		{
+			return expansion;
+		}
+	}
+
+	if (splitArguments(arguments, values, MAX_MACRO_PARAMETERS, definition->name) != definition->parameterCount)
+	{
+		displayError(MACRO_ARGUMENT_COUNT, definition->name);
+		exit(-1);
+	}
+
+	expansion = (macroExpansion*)malloc(sizeof(macroExpansion));
+	expansion->macroIndex = macroIndex;
+	expansion->arguments = strdup(arguments);
+	expansion->lineCount = definition->bodyCount;
+	expansion->lines = (segment*)malloc(sizeof(segment) * (definition->bodyCount ? definition->bodyCount : 1));
+
+	for (int x = 0; x < definition->bodyCount; x++)
+	{
+		expansion->lines[x] = definition->body[x];
+		substituteParameters(expansion->lines[x].label, definition, values);
+		substituteParameters(expansion->lines[x].operation, definition, values);
+		substituteParameters(expansion->lines[x].operand, definition, values);
+	}
+
+	expansion->next = table->expansions[hashIndex];
+	table->expansions[hashIndex] = expansion;
+	return expansion;
+}
+
+// Returns the index of the macro with the provided name; otherwise, -1
+int findMacro(macroTable* table, char* name)
+{
+	for (int x = 0; x < table->definitionCount; x++)
+	{
+		if (strcmp(table->definitions[x].name, name) == 0)
+		{
+			return x;
+		}
+	}
+	return -1;
+}
+
+// Releases the definition table and every cached expansion
+void freeMacroTable(macroTable* table)
+{
+	for (int x = 0; x < table->definitionCount; x++)
+	{
+		free(table->definitions[x].body);
+	}
+	free(table->definitions);
+
+	for (int x = 0; x < MACRO_CACHE_SIZE; x++)
+	{
+		macroExpansion* expansion = table->expansions[x];
+		while (expansion != NULL)
+		{
+			macroExpansion* next = expansion->next;
+			free(expansion->arguments);
+			free(expansion->lines);
+			free(expansion);
+			expansion = next;
+		}
+	}
+	initializeMacroTable(table);
+}
+
+// Returns true if the label or operand of the provided line is a $ local label; otherwise, false
+bool hasLocalLabel(segment* line)
+{
+	char* operand = line->operand;
+
+	if (operand[0] == '#' || operand[0] == '@')
+	{
+		operand++;
+	}
+	return line->label[0] == LOCAL_LABEL_CHARACTER || operand[0] == LOCAL_LABEL_CHARACTER;
+}
+
+// Set the definition table and the expansion cache to empty
+void initializeMacroTable(macroTable* table)
+{
+	memset(table, 0, sizeof(macroTable));
+}
+
+// Inserts the expansion identifier after the $ of a local label, e.g. $LOOP becomes $0ALOOP
+void insertExpansionId(char field[], int expansionId)
+{
+	char renamed[SEGMENT_SIZE * 2];
+	const char* digits = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+	renamed[0] = LOCAL_LABEL_CHARACTER;
+	renamed[1] = digits[(expansionId / EXPANSION_ID_RADIX) % EXPANSION_ID_RADIX];
+	renamed[2] = digits[expansionId % EXPANSION_ID_RADIX];
+	strcpy(&renamed[1 + EXPANSION_ID_DIGITS], &field[1]);
+
+	if (strlen(renamed) > SEGMENT_SIZE - 1)
+	{
+		displayError(ILLEGAL_MACRO, field);
+		exit(-1);
+	}
+	strcpy(field, renamed);
+}
+
+// Gives the $ local labels of an expanded line names that are unique to the provided expansion
+void renameLocalLabels(segment* line, int expansionId)
+{
+	char* operand = line->operand;
+
+	if (expansionId >= EXPANSION_ID_RADIX * EXPANSION_ID_RADIX)
+	{
+		displayError(ILLEGAL_MACRO, "Too many expansions");
+		exit(-1);
+	}
+
+	if (line->label[0] == LOCAL_LABEL_CHARACTER)
+	{
+		insertExpansionId(line->label, expansionId);
+	}
+	if (operand[0] == '#' || operand[0] == '@')
+	{
+		operand++;
+	}
+	if (operand[0] == LOCAL_LABEL_CHARACTER)
+	{
+		insertExpansionId(operand, expansionId);
+	}
+}
+
+// Splits a comma-separated MACRO parameter list or invocation argument list into values
+// Commas inside quoted BYTE constants do not separate values
+// Returns the number of values found
+int splitArguments(char* string, char values[][SEGMENT_SIZE], int maxValues, char* errorInfo)
+{
+	int count = 0, length = 0;
+	bool quoted = false;
+
+	if (string[0] == '\0')
+	{
+		return 0;
+	}
+
+	for (int x = 0; ; x++)
+	{
+		if (string[x] == SINGLE_QUOTE)
+		{
+			quoted = !quoted;
+		}
+
+		if (string[x] == '\0' || (string[x] == ARGUMENT_SEPARATOR && !quoted))
+		{
+			if (count == maxValues)
+			{
+				displayError(MACRO_ARGUMENT_COUNT, errorInfo);
+				exit(-1);
+			}
+			values[count++][length] = '\0';
+			length = 0;
+			if (string[x] == '\0')
+			{
+				return count;
+			}
+			continue;
+		}
+
+		if (length == SEGMENT_SIZE - 1)
+		{
+			displayError(ILLEGAL_MACRO, string);
+			exit(-1);
+		}
+		values[count][length++] = string[x];
+	}
+}
+
+// Replaces each &parameter in the provided field with its argument value
+void substituteParameters(char field[], macroDefinition* definition, char arguments[][SEGMENT_SIZE])
+{
+	char result[SEGMENT_SIZE * MAX_MACRO_PARAMETERS];
+	int length = 0;
+
+	if (strchr(field, PARAMETER_CHARACTER) == NULL)
+	{
+		return;
+	}
+
+	for (int x = 0; field[x] != '\0'; )
+	{
+		int match = -1, matchLength = 0;
+
+		if (field[x] == PARAMETER_CHARACTER)
+		{
+			// Prefer the longest parameter name so &AB is not replaced as &A followed by B
+			for (int y = 0; y < definition->parameterCount; y++)
+			{
+				int parameterLength = strlen(definition->parameters[y]);
+				if (parameterLength > matchLength && strncmp(&field[x], definition->parameters[y], parameterLength) == 0)
+				{
+					match = y;
+					matchLength = parameterLength;
+				}
+			}
+		}
+
+		if (match >= 0)
+		{
+			strcpy(&result[length], arguments[match]);
+			length += strlen(arguments[match]);
+			x += matchLength;
+		}
+		else
+		{
+			result[length++] = field[x++];
+		}
+	}
+	result[length] = '\0';
+
+	if (length > SEGMENT_SIZE - 1)
+	{
+		displayError(ILLEGAL_MACRO, result);
+		exit(-1);
+	}
+	strcpy(field, result);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#define LOCAL_LABEL_CHARACTER '$'
+#define MACRO_CACHE_SIZE 64
+#define MAX_MACRO_PARAMETERS 8
+
+// Used to store a single MACRO/MEND definition from the definition table
+typedef struct macroDefinition {
+	char name[SEGMENT_SIZE];
+	char parameters[MAX_MACRO_PARAMETERS][SEGMENT_SIZE];
+	int parameterCount;
+	segment* body;           // Lexed once when the definition is read
+	int bodyCount;
+	int bodyCapacity;
+	bool hasLocalLabels;     // Body contains $ labels that are renamed per expansion
+} macroDefinition;
+
+// Used to cache the parameter-substituted body of a macro for one argument tuple
+typedef struct macroExpansion {
+	int macroIndex;
+	char* arguments;
+	segment* lines;
+	int lineCount;
+	struct macroExpansion* next;
+} macroExpansion;
+
+// Used to store the macro definition table and the expansion cache
+typedef struct macroTable {
+	macroDefinition* definitions;
+	int definitionCount;
+	int definitionCapacity;
+	macroExpansion* expansions[MACRO_CACHE_SIZE];
+	int expansionCount;      // Number of expansions that required unique local labels
+} macroTable;
+
+void addMacroLine(macroTable* table, int macroIndex, segment* line);
+int defineMacro(macroTable* table, char* name, char* parameters);
+macroExpansion* expandMacro(macroTable* table, int macroIndex, char* arguments);
+int findMacro(macroTable* table, char* name);
+void freeMacroTable(macroTable* table);
+void initializeMacroTable(macroTable* table);
+void renameLocalLabels(segment* line, int expansionId);
@@ -1,29 +1,21 @@
-#include "headers.h"
+#include "assembler.h"
+
+#include <sys/resource.h>
 
 // Pass 1 constants
-#define COMMENT 35
-#define INPUT_BUF_SIZE 60
 #define NEW_LINE 10
-#define SPACE 32
-#define SYMBOL_TABLE_SIZE 100
 
 // Pass 2 constants
 #define BLANK_INSTRUCTION 0x000000
-#define FLAG_B 0x04
-#define FLAG_E 0x01
+#define BOUNDED_LINE_COST (sizeof(sourceLine) + 14 * sizeof(int))  // A window line, its encoding and its batch entry
+#define BOUNDED_RESERVE (1L << 20)      // Part of the --max-memory budget kept for the output files of Pass 2
+#define MIN_BOUNDED_MEMORY (8L << 20)
+#define MIN_BOUNDED_WINDOW 1024
 #define FLAG_I 0x10
 #define FLAG_N 0x20
-#define FLAG_P 0x02
-#define FLAG_X 0x08
-#define FORMAT_1 1
-#define FORMAT_2 2
-#define FORMAT_3 3
 #define FORMAT_3_MULTIPLIER 0x1000
-#define FORMAT_4 4
 #define FORMAT_4_MULTIPLIER 0x100000
-#define IMMEDIATE_CHARACTER '#'
-#define INDEX_STRING ",X"
-#define INDIRECT_CHARACTER '@'
+#define HEADER_RECORD_SIZE 20
 #define MAX_RECORD_BYTE_COUNT 30
 #define OPCODE_MULTIPLIER 0x100
 #define OUTPUT_BUF_SIZE 70
@@ -35,152 +27,516 @@
 #define REGISTER_T 0X5
 #define REGISTER_X 0X1
 #define RSUB_INSTRUCTION 0x4C0000
-#define BASE_MAX_RANGE 4096
-#define PC_MAX_RANGE 2048
-#define PC_MIN_RANGE -2048
+
+// Command-line functions
+void assembleBounded(char* filename, options* settings, assembly* state);
+void assembleCached(char* filename, options* settings, assembly* state);
+void assembleSource(char* filename, options* settings, assembly* state);
+void checkMemoryLimit(long used, long limit);
+char* findConflictingOptions(options* settings, int fileCount);
+void freeAssembly(assembly* state);
+long getPeakMemory(void);
+int parseOptions(int argc, char* argv[], options* settings, char* filenames[]);
+
+// Watch mode functions
+bool hasSameLayout(lineStream* previous, lineStream* current);
+void reassembleSource(char* filename, options* settings, assembly* state, assembly* next);
+void watchSource(char* filename, options* settings, assembly* state);
+void writeDebugOutputs(char* filename, options* settings, assembly* state);
 
 // Pass 1 functions
-void performPass1(symbol* symbolTable[], char* filename, address* addresses);
-segment* prepareSegments(char* line);
-void trim(char string[]);
+int assignLineAddress(symbolTable* symbols, sourceLine* line, int current);
+void performPass1(symbolTable* symbols, char* filename, address* addresses, lineStream* lines, pipeline* stages, spillFile* spill);
+void relaxFormats(symbolTable* symbols, address* addresses, lineStream* lines);
 
 // Pass 2 functions
-int computeFlagsAndAddress(struct symbol* symbolArray[], address* addresses, segment* segments, int format);
+void closePass2Output(pass2Output* out, address* addresses);
+int computeFlagsAndAddress(symbolTable* symbols, address* addresses, sourceLine* line, int format);
 char* createFilename(char* filename, const char* extension);
+void encodeFormat34(symbolTable* symbols, lineStream* lines, int* encodings, int first, int last, int* base);
+void* encodeStage(void* argument);
 void flushTextRecord(FILE* file, objectFileData* data, address* addresses);
+int getOperandFormat(sourceLine* line, int rsubId);
 int getRegisters(char* operand);
 int getRegisterValue(char registerName);
-bool isNumeric(char* string);
-void performPass2(struct symbol* symbolTable[], char* filename, address* addresses);
-void writeToLstFile(FILE* file, int address, segment* segments, int opcode);
+void openPass2Output(pass2Output* out, char* filename, address* addresses, options* settings, pipeline* stages);
+void performPass2(symbolTable* symbols, char* filename, address* addresses, lineStream* lines, int* encodings, options* settings, pipeline* stages);
+int resolveOperand(symbolTable* symbols, sourceLine* line, int format, int* mode);
+void writePass2Lines(pass2Output* out, symbolTable* symbols, address* addresses, lineStream* lines, int* encodings, int firstLine);
 void writeToObjFile(FILE* file, objectFileData data);
 
 int main(int argc, char* argv[])
 {
 	// Do not modify this statement
 	address addresses = { 0x00, 0x00, 0x00 };
+	options settings = { .cacheSize = CACHE_DEFAULT_SIZE };
+	char** filenames = (char**)malloc(sizeof(char*) * argc);
+	int fileCount = parseOptions(argc, argv, &settings, filenames);
+	int diagnosticCount = 0;
+	bool assembling;
+	char* conflict;
+
+	// The directive and opcode names are interned before any source, so every lexed line is classified by its IDs
+	internDirectives();
+	internOpcodes();
 
 	// Check if at least one input file was provided
-	if(argc < 2)
+	if(fileCount == 0)
 	{
 		displayError(MISSING_COMMAND_LINE_ARGUMENTS, argv[0]);
 		exit(-1);
 	}
+	if ((conflict = findConflictingOptions(&settings, fileCount)) != NULL)
+	{
+		displayError(CONFLICTING_OPTIONS, conflict);
+		exit(-1);
+	}
 
-	symbol* symbols[SYMBOL_TABLE_SIZE] = { NULL };
+	// With --async-io, the input files are read ahead of the job that assembles them
+	assembling = !(settings.render || settings.disassemble || settings.load || settings.bench || settings.translate ||
+		settings.check);
+	if (settings.asyncIO && assembling)
+	{
+		startAsyncIO(filenames, fileCount);
+	}
 
-	performPass1(symbols, argv[1], &addresses);
+	// Each input file is handled as a separate job; files they include are lexed once for all of them
+	for (int x = 0; x < fileCount; x++)
+	{
+		char* filename = filenames[x];
+		assembly state = { { NULL }, { NULL, 0, 0 }, addresses, NULL };
 
-	performPass2(symbols, argv[1], &addresses);
+		advanceAsyncIO(x);
 
+		if (settings.render)
+		{
+			beginIncludeRecord();
+			readLineStream(filename, &state.lines);
+			renderListing(createFilename(filename, ".lsx"), filename, createFilename(filename, ".lst"), &state.lines);
+			freeLineStream(&state.lines);
+		}
+		else if (settings.disassemble)
+		{
+			disassembleFile(filename, createFilename(filename, ".dis"), createFilename(filename, ".dbg"));
+		}
+		else if (settings.load)
+		{
+			memoryImage image;
+			loadObjectFile(filename, &image);
+			displayMemoryImage(&image);
+			freeMemoryImage(&image);
+		}
+		else if (settings.bench)
+		{
+			runBenchmarks(filename, settings.benchJson ? createFilename(filename, ".bench.json") : NULL);
+		}
+		else if (settings.translate)
+		{
+			translateFile(filename, createFilename(filename, ".c"));
+		}
+		else if (settings.check)
+		{
+			diagnosticCount += checkSource(filename);
+		}
+		else if (settings.watch)
+		{
+			watchSource(filename, &settings, &state);
+		}
+		else if (settings.maxMemory)
+		{
+			assembleBounded(filename, &settings, &state);
+			freeAssembly(&state);
+		}
+		// --symbols and --analyze print reports of the assembly itself, so they always assemble
+		else if (settings.cacheDir && !settings.symbols && !settings.analyze)
+		{
+			assembleCached(filename, &settings, &state);
+		}
+		else
+		{
+			assembleSource(filename, &settings, &state);
+			freeAssembly(&state);
+		}
+
+		if (settings.delta != NULL && assembling && !settings.watch)
+		{
+			awaitAsyncWrites();
+			writeDeltaObject(createFilename(filename, ".obj"), settings.delta, createFilename(filename, ".delta.obj"),
+				settings.packLimit ? settings.packLimit : MAX_RECORD_BYTE_COUNT);
+		}
+	}
+	finishAsyncIO();
+	free(filenames);
+
+	// --check prints nothing but its JSON, so editors can parse the output, and fails if any file has a diagnostic
+	if (settings.check)
+	{
+		return diagnosticCount > 0;
+	}
 	printf("\n\nDone!\n\n");
 }
 
-// Determines the Format 3/4 flags and computes address displacement for Format 3 instruction
-int computeFlagsAndAddress(symbol* symbolArray[], address* addresses, segment* segments, int format)
+// Performs both passes over the source file without keeping its line stream, so memory use does not
+// grow with the length of the source: Pass 1 spills the address of each line to a temporary file, and
+// Pass 2 streams the source again together with the spill file, one window of lines at a time
+// The window gets the part of the --max-memory limit that the process has not used by the end of Pass 1,
+// less a reserve for the output files; a limit that leaves no room for a window is an error
+void assembleBounded(char* filename, options* settings, assembly* state)
 {
-	// Extract operation and operand from the segment
-	    char op[SEGMENT_SIZE];
-	    char operand[SEGMENT_SIZE];
-	    strcpy(op, segments->operation);
-	    strcpy(operand, segments->operand);
-
-	    // Determine if operand uses immediate (#), indirect (@), or indexed (,X) addressing
-	    bool isImmediate = (operand[0] == IMMEDIATE_CHARACTER);
-	    bool isIndirect = (operand[0] == INDIRECT_CHARACTER);
-	    bool isIndexed = (strstr(operand, INDEX_STRING) != NULL);
-
-	    // Clean up operand: remove addressing symbols and ",X" if present
-	    if (isImmediate || isIndirect) {
-	        memmove(operand, operand + 1, strlen(operand));
-	    }
-	    char* comma = strstr(operand, INDEX_STRING);
-	    if (comma != NULL) {
-	        *comma = '\0'; // Remove ,X
-	    }
+	long window = MIN_BOUNDED_WINDOW * BOUNDED_LINE_COST;
+	int windowSize, firstLine = 0, base = 0;
+	long peak;
+	sourceReader reader;
+	sourceLine line;
+	pass2Output out;
+	spillFile spill;
+
+	checkMemoryLimit(getPeakMemory() + BOUNDED_RESERVE + window, settings->maxMemory);
+	beginIncludeRecord();
+	openSpill(&spill);
+	performPass1(&state->symbols, filename, &state->addresses, &state->lines, NULL, &spill);
+	rewindSpill(&spill);
+
+	peak = getPeakMemory();
+	checkMemoryLimit(peak + BOUNDED_RESERVE + window, settings->maxMemory);
+	windowSize = (settings->maxMemory - peak - BOUNDED_RESERVE) / BOUNDED_LINE_COST;
+
+	state->lines.lines = (sourceLine*)realloc(state->lines.lines, sizeof(sourceLine) * windowSize);
+	state->lines.capacity = windowSize;
+	state->encodings = (int*)malloc(sizeof(int) * windowSize);
+
+	openSourceStream(&reader, filename);
+	openPass2Output(&out, filename, &state->addresses, settings, NULL);
+	do
+	{
+		state->lines.count = 0;
+		while (state->lines.count < windowSize && nextSourceLine(&reader, &line))
+		{
+			readSpillRecord(&spill, &line.address);
+			appendLine(&state->lines, &line);
+		}
 
-	    // Set n and i flags
-	    int n, i;
-	    if (isImmediate && isNumeric(operand)) {
-	        // Pure immediate numeric
-	        n = 0;
-	        i = 1;
-	    } else if (format == FORMAT_4) {
-	        // Format 4 always uses simple addressing
-	        n = 1;
-	        i = 1;
-	    } else {
-	        // Format 3: set based on @ or #
-	        n = (isIndirect || (!isImmediate && !isIndirect)) ? 1 : 0;
-	        i = (isImmediate || (!isImmediate && !isIndirect)) ? 1 : 0;
-	    }
+		encodeFormat34(&state->symbols, &state->lines, state->encodings, 0, state->lines.count, &base);
+		writePass2Lines(&out, &state->symbols, &state->addresses, &state->lines, state->encodings, firstLine);
+		firstLine += state->lines.count;
+	} while (state->lines.count == windowSize);
 
-	    // First byte: 6-bit opcode + ni flags
-	    int opcode = getOpcodeValue(op) & 0xFC;
-	    int byte1 = opcode | (n << 1) | i;
-
-	    // Handle immediate numeric literals
-	    if (isImmediate && isNumeric(operand)) {
-	        int value = strtol(operand, NULL, 10);
-	        if (format == FORMAT_4) {
-	            // 4-byte encoding: opcode + nixbpe + 20-bit address
-	            int byte2 = (1 << 4); // e=1, rest flags 0
-	            return (byte1 << 24) | (byte2 << 16) | ((value >> 8) << 8) | (value & 0xFF);
-	        } else {
-	            // 3-byte encoding: opcode + nixbpe + 12-bit constant
-	            return (byte1 << 16) | (value & 0xFFF);
-	        }
-	    }
+	closeSourceReader(&reader);
+	closePass2Output(&out, &state->addresses);
+	closeSpill(&spill);
 
-	    // Lookup target address from symbol table
-	    int targetAddr = getSymbolAddress(symbolArray, operand);
-
-	    // Calculate displacement or address based on format
-	    int disp = 0, b = 0, p = 0, e = (format == FORMAT_4 ? 1 : 0);
-	    int nextPC = addresses->current + 3; // PC-relative uses PC after this instruction
-
-	    if (format == FORMAT_4) {
-	        // Use absolute 20-bit address for format 4
-	        disp = targetAddr;
-	    } else {
-	        // Format 3: use PC or base relative addressing
-	        int diff = targetAddr - nextPC;
-	        if (diff >= PC_MIN_RANGE && diff <= PC_MAX_RANGE) {
-	            p = 1;
-	            disp = diff & 0xFFF;
-	        } else {
-	            b = 1;
-	            disp = (targetAddr - addresses->base) & 0xFFF;
-	        }
-	    }
+	peak = getPeakMemory();
+	printf("Peak memory: %ld KB of %ld KB.\n", peak / 1024, settings->maxMemory / 1024);
+	checkMemoryLimit(peak, settings->maxMemory);
+}
 
-	    int x = isIndexed ? 1 : 0;
-	    int flags = (x << 3) | (b << 2) | (p << 1) | e;
-
-	    // Final object code: depends on format
-	    if (format == FORMAT_4) {
-	        int byte2 = (flags << 4) | ((disp >> 16) & 0x0F);
-	        int byte3 = (disp >> 8) & 0xFF;
-	        int byte4 = disp & 0xFF;
-	        return (byte1 << 24) | (byte2 << 16) | (byte3 << 8) | byte4;
-	    } else {
-	        int byte2 = (flags << 4) | ((disp >> 8) & 0x0F);
-	        int byte3 = disp & 0xFF;
-	        return (byte1 << 16) | (byte2 << 8) | byte3;
-	    }
+// Writes the output files stored in the output cache for the source, its included files and the options
+// On a miss, the source is assembled and its output files are stored for the next run
+void assembleCached(char* filename, options* settings, assembly* state)
+{
+	cacheKey key;
+
+	if (restoreCachedOutputs(filename, settings, &key))
+	{
+		return;
+	}
+
+	assembleSource(filename, settings, state);
+	freeAssembly(state);
+	awaitAsyncWrites();
+	storeCachedOutputs(filename, settings, &key, getIncludeRecord());
+}
+
+// Performs both passes over the source file and writes the output files
+// The Symbol Table, line stream and encodings are kept in the provided assembly
+// With --pipeline, lexing overlaps Pass 1, and encoding and writing overlap Pass 2
+void assembleSource(char* filename, options* settings, assembly* state)
+{
+	pipeline* stages;
+	int base = 0;
+
+	// The include record starts before the lexer stage can include a file
+	beginIncludeRecord();
+	// An error in a stage thread cannot return to the watch loop, so watch mode assembles serially
+	stages = settings->pipeline && !settings->watch ? startPipeline(filename, state) : NULL;
+
+	performPass1(&state->symbols, filename, &state->addresses, &state->lines, stages, NULL);
+
+	if (settings->analyze || settings->stripUnused)
+	{
+		analyzeReferences(filename, state, settings->stripUnused);
+	}
+
+	if (settings->optimize)
+	{
+		relaxFormats(&state->symbols, &state->addresses, &state->lines);
+	}
+
+	state->encodings = (int*)malloc(sizeof(int) * (state->lines.count + 1));
+	if (stages != NULL)
+	{
+		// Once RSUB is interned, the stages only ever read the intern pool
+		internName("RSUB");
+		pthread_create(&stages->encoder, NULL, encodeStage, stages);
+	}
+	else
+	{
+		// Encode every Format 3/4 instruction before the records are written
+		encodeFormat34(&state->symbols, &state->lines, state->encodings, 0, state->lines.count, &base);
+	}
+
+	performPass2(&state->symbols, filename, &state->addresses, &state->lines, state->encodings, settings, stages);
+	if (stages != NULL)
+	{
+		finishPipeline(stages);
+	}
+	writeDebugOutputs(filename, settings, state);
+}
+
+// Checks the label and operation of a Pass 1 line, enters its label in the Symbol Table and sets its address
+// The label goes in before the operation is checked, so --check, which goes on past an error, does not also
+// report the operands that refer to it as unknown
+// Returns the number of bytes the line takes
+int assignLineAddress(symbolTable* symbols, sourceLine* line, int current)
+{
+	segment* segments = &line->segments;
+	int dirType = getDirectiveType(line->operationId);
+
+	line->address = current;
+	if (current >= 0x100000)
+	{
+		char value[10];
+		sprintf(value, "0x%X", current);
+		displayError(OUT_OF_MEMORY, value);
+		exit(-1);
+	}
+	if (getDirectiveType(line->labelId) || getOpcodeValueById(line->labelId) >= 0)
+	{
+		displayError(ILLEGAL_SYMBOL, segments->label);
+		exit(-1);
+	}
+
+	// The label of START names the program rather than an address
+	if (isStartDirective(dirType))
+	{
+		line->address = strtol(segments->operand, NULL, 16);
+		return 0;
+	}
+	if (strlen(segments->label) > 0)
+	{
+		insertSymbol(symbols, line->labelId, current);
+	}
+
+	if (dirType)
+	{
+		return getMemoryAmount(dirType, segments->operand);
+	}
+	if (getOpcodeValueById(line->operationId) < 0)
+	{
+		displayError(ILLEGAL_OPCODE_DIRECTIVE, segments->operation);
+		exit(-1);
+	}
+	if (isIllegalFormat4(segments->operation))
+	{
+		displayError(ILLEGAL_OPCODE_FORMAT, segments->operation);
+		exit(-1);
+	}
+	return getOpcodeFormatById(line->operationId);
+}
+
+// Ends the assembly with an error if the provided memory use, in bytes, exceeds the --max-memory limit
+void checkMemoryLimit(long used, long limit)
+{
+	char info[50];
+
+	if (used > limit)
+	{
+		sprintf(info, "%ld KB of %ld KB", used / 1024, limit / 1024);
+		displayError(MEMORY_LIMIT, info);
+		exit(-1);
+	}
+}
+
+// Writes the last Text record, the Header record and the End record and closes the Pass 2 output files
+// Watch mode renames the files into place only now, so a failed assembly leaves the previous files
+void closePass2Output(pass2Output* out, address* addresses)
+{
+    setErrorLocation(NULL, 0);
+    if (out->txt.recordEntryCount > 0) {
+        flushTextRecord(out->obj, &out->txt, addresses);
+    }
+    finishPackedRecords(&out->packer);
+
+    out->hdr.programSize = addresses->current - out->hdr.startAddress;
+
+    // Seek back to top and write the header now that size is known
+    fseek(out->obj, 0, SEEK_SET);
+    writeToObjFile(out->obj, out->hdr);
+
+    objectFileData endRec = {0};
+    endRec.recordType = 'E';
+    endRec.startAddress = out->execAddr;
+    fseek(out->obj, 0, SEEK_END);
+    writeToObjFile(out->obj, endRec);
+
+    if (out->settings->packLimit) {
+        printf("Packed %d Text records of up to %d bytes (%d fill bytes); object file is %ld bytes.\n",
+                out->packer.recordCount, out->settings->packLimit, out->packer.fillCount, ftell(out->obj));
+    }
+
+    closeListing(&out->lst);
+    fclose(out->obj);
+
+    if (out->settings->watch) {
+        rename(out->objTemp, out->objName);
+        if (out->settings->listingMode != LISTING_NONE) {
+            rename(out->lstTemp, out->lstName);
+        }
+        free(out->lstTemp);
+        free(out->objTemp);
+    }
+    free(out->lstName);
+    free(out->objName);
+}
+
+// Determines the Format 3/4 flags and computes address displacement for Format 3 instruction
+int computeFlagsAndAddress(symbolTable* symbols, address* addresses, sourceLine* line, int format)
+{
+	int mode;
+	int target = resolveOperand(symbols, line, format, &mode);
+	int objCode;
+
+	if (!encodeInstruction(getOpcodeValueById(line->operationId), mode, target, addresses->current, addresses->base,
+			&objCode))
+	{
+		displayError(ADDRESS_OUT_OF_RANGE, line->segments.operation);
+		exit(-1);
+	}
+	return objCode;
 }
 
-// Do no modify any part of this function
 // Returns a new filename using the provided filename and extension
 char* createFilename(char* filename, const char* extension)
 {
-	char* temp = (char*)malloc(sizeof(char) * strlen(filename) + 1);
-	int n = strchr(filename, '.') - filename;
+	char* temp = (char*)malloc(sizeof(char) * (strlen(filename) + strlen(extension) + 1));
+	char* dot = strrchr(filename, '.');
+	size_t n = (dot != NULL && strchr(dot, '/') == NULL) ? (size_t)(dot - filename) : strlen(filename);
 	strncpy(temp, filename, n);
+	temp[n] = '\0';
 	strcat(temp, extension);
 	return temp;
 }
 
+// Releases the Symbol Table, line stream and encodings held by the assembly
+void freeAssembly(assembly* state)
+{
+	freeSymbolTable(&state->symbols);
+	freeLineStream(&state->lines);
+	free(state->encodings);
+	state->encodings = NULL;
+}
+
+// Resolves the operand of every Format 3/4 instruction in a range of the line stream and encodes them as one batch
+// The encoding of each instruction is stored at the index of its line; base carries BASE from range to range
+void encodeFormat34(symbolTable* symbols, lineStream* lines, int* encodings, int first, int last, int* base)
+{
+	instructionBatch batch = { NULL };
+	int* batchLines = (int*)malloc(sizeof(int) * (last - first + 1));
+	int rsubId = internName("RSUB");
+	int failed;
+
+	for (int x = first; x < last; x++)
+	{
+		setErrorLocation(getName(lines->lines[x].fileId), lines->lines[x].lineNumber);
+		if (isBaseDirective(getDirectiveType(lines->lines[x].operationId)))
+		{
+			*base = getSymbolAddress(symbols, lines->lines[x].symbolId);
+			continue;
+		}
+
+		int format = getOperandFormat(&lines->lines[x], rsubId);
+		if (!format)
+		{
+			continue;
+		}
+
+		int mode;
+		int target = resolveOperand(symbols, &lines->lines[x], format, &mode);
+		batchLines[batch.count] = x;
+		addInstruction(&batch, getOpcodeValueById(lines->lines[x].operationId), mode, target, lines->lines[x].address, *base);
+	}
+
+	if ((failed = encodeInstructions(&batch)) >= 0)
+	{
+		setErrorLocation(getName(lines->lines[batchLines[failed]].fileId), lines->lines[batchLines[failed]].lineNumber);
+		displayError(ADDRESS_OUT_OF_RANGE, lines->lines[batchLines[failed]].segments.operation);
+		exit(-1);
+	}
+
+	for (int x = 0; x < batch.count; x++)
+	{
+		encodings[batchLines[x]] = batch.codes[x];
+	}
+	setErrorLocation(NULL, 0);
+	free(batchLines);
+	freeInstructionBatch(&batch);
+}
+
+// Encoder thread: encodes the Format 3/4 instructions of a pipelined assembly one batch of lines at a
+// time, so Pass 2 can format the first lines while the rest are encoded
+void* encodeStage(void* argument)
+{
+	pipeline* stages = (pipeline*)argument;
+	assembly* state = stages->state;
+	int base = 0;
+
+	for (int first = 0; first < state->lines.count; first += PIPELINE_BATCH_SIZE)
+	{
+		int last = first + PIPELINE_BATCH_SIZE < state->lines.count ? first + PIPELINE_BATCH_SIZE : state->lines.count;
+		encodeFormat34(&state->symbols, &state->lines, state->encodings, first, last, &base);
+
+		lineRange* range = (lineRange*)claimSlot(&stages->encoded);
+		range->first = first;
+		range->count = last - first;
+		publishSlot(&stages->encoded);
+	}
+	closeRing(&stages->encoded);
+	return NULL;
+}
+
+// Returns the names of the first two options that cannot be used together; otherwise, NULL
+// Watch mode keeps a single file resident, a delta object is written against a single previous file, and
+// a bounded-memory assembly keeps no line stream to relax, index or keep resident; the output cache and
+// asynchronous I/O only stand in for the reads and writes of a whole assembly
+char* findConflictingOptions(options* settings, int fileCount)
+{
+	bool bounded = settings->maxMemory != 0;
+	struct { bool conflicting; char* names; } conflicts[] = {
+		{ settings->watch && fileCount > 1, "--watch and more than one input file" },
+		{ settings->delta && fileCount > 1, "--delta and more than one input file" },
+		{ bounded && settings->optimize, "--max-memory and --optimize" },
+		{ bounded && settings->watch, "--max-memory and --watch" },
+		{ bounded && settings->debugInfo, "--max-memory and --debug-info" },
+		{ bounded && settings->symbols, "--max-memory and --symbols" },
+		{ bounded && settings->pipeline, "--max-memory and --pipeline" },
+		{ bounded && settings->analyze, "--max-memory and --analyze" },
+		{ bounded && settings->stripUnused, "--max-memory and --strip-unused" },
+		{ bounded && settings->cacheDir, "--max-memory and --cache-dir" },
+		{ bounded && settings->asyncIO, "--max-memory and --async-io" },
+		{ settings->watch && settings->cacheDir, "--watch and --cache-dir" },
+		{ settings->watch && settings->asyncIO, "--watch and --async-io" }
+	};
+
+	for (size_t x = 0; x < sizeof(conflicts) / sizeof(conflicts[0]); x++)
+	{
+		if (conflicts[x].conflicting)
+		{
+			return conflicts[x].names;
+		}
+	}
+	return NULL;
+}
+
 // Do no modify any part of this function
 // Writes existing data to Object Data file and resets values
 void flushTextRecord(FILE* file, objectFileData* data, address* addresses)
@@ -191,6 +547,26 @@ void flushTextRecord(FILE* file, objectFileData* data, address* addresses)
 	data->recordEntryCount = 0;
 }
 
+// Returns the format of a Format 3/4 instruction whose operand Pass 2 encodes; otherwise, 0
+// An unknown operation or a '+' on a Format 1 or 2 opcode is 0, so --check, which goes on past the errors of
+// Pass 1, skips those lines
+int getOperandFormat(sourceLine* line, int rsubId)
+{
+	int format = getDirectiveType(line->operationId) || isIllegalFormat4(line->segments.operation) ? 0 :
+		getOpcodeFormatById(line->operationId);
+
+	return (format == FORMAT_3 || format == FORMAT_4) && line->operationId != rsubId ? format : 0;
+}
+
+// Returns the peak resident memory of the process so far, in bytes
+long getPeakMemory(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss * 1024L;
+}
+
 // Do no modify any part of this function
 // Returns a hex byte containing the registers listed in the provided operand
 int getRegisters(char* operand)
@@ -221,167 +597,583 @@ int getRegisterValue(char registerName)
 	}
 }
 
-// Do no modify any part of this function
-// Returns true if the provided string contains a numeric value; otherwise, false
-bool isNumeric(char* string)
+// Returns true if two line streams assign the same addresses and symbols; otherwise, false
+// Only the operands of instructions and of END may differ, since they do not change the size of a line
+bool hasSameLayout(lineStream* previous, lineStream* current)
 {
-	for(int x = 0; x < strlen(string); x++)
+	if (previous->count != current->count)
+	{
+		return false;
+	}
+
+	for (int x = 0; x < current->count; x++)
 	{
-		if(!isdigit(string[x])) return false;
+		segment* before = &previous->lines[x].segments;
+		segment* after = &current->lines[x].segments;
+		int directiveType = getDirectiveType(current->lines[x].operationId);
+
+		if (previous->lines[x].labelId != current->lines[x].labelId ||
+				previous->lines[x].operationId != current->lines[x].operationId)
+		{
+			return false;
+		}
+		if (directiveType && !isEndDirective(directiveType) && strcmp(before->operand, after->operand) != 0)
+		{
+			return false;
+		}
 	}
 	return true;
 }
 
-// Do no modify any part of this function
-// Performs Pass 1 of the SIC/XE assembler
-void performPass1(symbol* symbolTable[], char* filename, address* addresses)
+// Opens the .obj file and the listing that Pass 2 writes to
+// Watch mode writes each file under a temporary name; with --pack, Text records are packed up to the
+// chosen length; in a pipeline, the files are written by the writer thread
+void openPass2Output(pass2Output* out, char* filename, address* addresses, options* settings, pipeline* stages)
 {
-	char line[INPUT_BUF_SIZE];
-	FILE* file;
-	int directiveType = 0;
+    memset(out, 0, sizeof(pass2Output));
+    out->settings = settings;
+    out->stages = stages;
+    out->execAddr = addresses->start;
+    out->rsubId = internName("RSUB");
+
+    out->lstName = createFilename(filename, settings->listingMode == LISTING_SIDECAR ? ".lsx" : ".lst");
+    out->objName = createFilename(filename, ".obj");
+    out->lstTemp = settings->watch ? createFilename(out->lstName, settings->listingMode == LISTING_SIDECAR ? ".lsx.tmp" : ".lst.tmp") : out->lstName;
+    out->objTemp = settings->watch ? createFilename(out->objName, ".obj.tmp") : out->objName;
+    out->obj = openOutputFile(out->objTemp, "w+", stages);  // opened in "w+" mode for read/write
+
+    if (!out->obj) {
+        displayError(FILE_NOT_FOUND, filename);
+        exit(-1);
+    }
+    openListing(&out->lst, out->lstTemp, filename, settings->listingMode, stages);
+    initializeRecordPacker(&out->packer, out->obj, settings->packLimit);
+
+    out->hdr.recordType = 'H';
+    out->txt.recordType = 'T';
 
-	file = fopen(filename, "r");
-	if (!file)
+    addresses->current = addresses->start;
+
+    // Reserve space for the header record, which is always HEADER_RECORD_SIZE characters
+    fseek(out->obj, HEADER_RECORD_SIZE, SEEK_SET);
+
+    out->txt.recordAddress = addresses->current;
+}
+
+// Separates the command-line options from the input filenames, which are stored in order
+// Returns the number of input files; otherwise, 0 (an option is not recognized)
+int parseOptions(int argc, char* argv[], options* settings, char* filenames[])
+{
+	int fileCount = 0;
+
+	for (int x = 1; x < argc; x++)
 	{
-		displayError(FILE_NOT_FOUND, filename);
-		exit(-1);
+		if (strcmp(argv[x], "--optimize") == 0)
+		{
+			settings->optimize = true;
+		}
+		else if (strcmp(argv[x], "--no-listing") == 0)
+		{
+			settings->listingMode = LISTING_NONE;
+		}
+		else if (strcmp(argv[x], "--listing-sidecar") == 0)
+		{
+			settings->listingMode = LISTING_SIDECAR;
+		}
+		else if (strcmp(argv[x], "--render-listing") == 0)
+		{
+			settings->render = true;
+		}
+		else if (strcmp(argv[x], "--debug-info") == 0)
+		{
+			settings->debugInfo = true;
+		}
+		else if (strcmp(argv[x], "--symbols") == 0)
+		{
+			settings->symbols = true;
+		}
+		else if (strcmp(argv[x], "--watch") == 0)
+		{
+			settings->watch = true;
+		}
+		else if (strcmp(argv[x], "--disassemble") == 0)
+		{
+			settings->disassemble = true;
+		}
+		else if (strcmp(argv[x], "--load") == 0)
+		{
+			settings->load = true;
+		}
+		else if (strcmp(argv[x], "--analyze") == 0)
+		{
+			settings->analyze = true;
+		}
+		else if (strcmp(argv[x], "--strip-unused") == 0)
+		{
+			settings->stripUnused = true;
+		}
+		else if (strcmp(argv[x], "--bench") == 0)
+		{
+			settings->bench = true;
+		}
+		else if (strcmp(argv[x], "--bench-json") == 0)
+		{
+			settings->bench = settings->benchJson = true;
+		}
+		else if (strcmp(argv[x], "--translate") == 0)
+		{
+			settings->translate = true;
+		}
+		else if (strcmp(argv[x], "--check") == 0)
+		{
+			settings->check = true;
+		}
+		else if (strcmp(argv[x], "--async-io") == 0)
+		{
+			settings->asyncIO = true;
+		}
+		else if (strcmp(argv[x], "--pipeline") == 0)
+		{
+			settings->pipeline = true;
+		}
+		else if (strcmp(argv[x], "--max-memory") == 0 && x + 1 < argc)
+		{
+			char* end;
+			settings->maxMemory = strtol(argv[++x], &end, 10);
+			if (*end == 'K' || *end == 'M' || *end == 'G')
+			{
+				settings->maxMemory <<= *end == 'K' ? 10 : *end == 'M' ? 20 : 30;
+				end++;
+			}
+			if (*end != '\0' || settings->maxMemory < MIN_BOUNDED_MEMORY)
+			{
+				return 0;
+			}
+		}
+		else if (strcmp(argv[x], "--cache-dir") == 0 && x + 1 < argc)
+		{
+			settings->cacheDir = argv[++x];
+		}
+		else if (strcmp(argv[x], "--cache-size") == 0 && x + 1 < argc)
+		{
+			char* end;
+			settings->cacheSize = strtol(argv[++x], &end, 10);
+			if (*end == 'K' || *end == 'M' || *end == 'G')
+			{
+				settings->cacheSize <<= *end == 'K' ? 10 : *end == 'M' ? 20 : 30;
+				end++;
+			}
+			if (*end != '\0' || settings->cacheSize < 1)
+			{
+				return 0;
+			}
+		}
+		else if (strcmp(argv[x], "--delta") == 0 && x + 1 < argc)
+		{
+			settings->delta = argv[++x];
+		}
+		else if (strcmp(argv[x], "--pack") == 0 && x + 1 < argc)
+		{
+			char* end;
+			settings->packLimit = strtol(argv[++x], &end, 10);
+			if (*end != '\0' || settings->packLimit < 1 || settings->packLimit > MAX_PACKED_RECORD_SIZE)
+			{
+				return 0;
+			}
+		}
+		else if (strncmp(argv[x], "--", 2) == 0)
+		{
+			return 0;
+		}
+		else
+		{
+			filenames[fileCount++] = argv[x];
+		}
+	}
+	return fileCount;
+}
+
+// Performs Pass 1 of the SIC/XE assembler
+// The lexed, macro-expanded lines are kept in the line stream for Pass 2
+// In a pipeline, the lines are lexed by the lexer thread instead
+// In a bounded-memory assembly, the source is streamed and only the address of each line is kept, in the spill file
+void performPass1(symbolTable* symbols, char* filename, address* addresses, lineStream* lines, pipeline* stages, spillFile* spill)
+{
+	sourceReader reader;
+	sourceLine line;
+
+	if (spill != NULL) {
+	    openSourceStream(&reader, filename);
+	} else if (stages == NULL) {
+	    openSourceReader(&reader, filename);
 	}
 
-	while (fgets(line, INPUT_BUF_SIZE, file)) {
-	    if (addresses->current >= 0x100000) {
-	        char value[10];
-	        sprintf(value, "0x%X", addresses->current);
-	        displayError(OUT_OF_MEMORY, value);
-	        exit(-1);
+	while (stages != NULL ? nextLexedLine(stages, &line) : nextSourceLine(&reader, &line)) {
+	    setErrorLocation(getName(line.fileId), line.lineNumber);
+
+	    sourceLine* stored = appendLine(lines, &line);
+
+	    addresses->increment = assignLineAddress(symbols, stored, addresses->current);
+	    if (isStartDirective(getDirectiveType(line.operationId))) {
+	        addresses->start = stored->address;
 	    }
+	    addresses->current = stored->address + addresses->increment;
 
-	    if (line[0] < 32) {
-	        displayError(BLANK_RECORD, NULL);
-	        exit(-1);
-	    } else if (line[0] == COMMENT) {
-	        continue;
+	    if (spill != NULL) {
+	        writeSpillRecord(spill, stored->address);
+	        lines->count = 0;
 	    }
+	}
+	if (spill != NULL || stages == NULL) {
+	    closeSourceReader(&reader);
+	}
+	setErrorLocation(NULL, 0);
+}
 
-	    segment* segments = prepareSegments(line);
+// Performs Pass 2 of the SIC/XE assembler
+void performPass2(symbolTable* symbols, char* filename, address* addresses, lineStream* lines, int* encodings, options* settings, pipeline* stages)
+{
+    pass2Output out;
 
-	    if (isDirective(segments->label) || isOpcode(segments->label)) {
-	        displayError(ILLEGAL_SYMBOL, segments->label);
-	        exit(-1);
-	    }
+    openPass2Output(&out, filename, addresses, settings, stages);
+    writePass2Lines(&out, symbols, addresses, lines, encodings, 0);
+    closePass2Output(&out, addresses);
+}
 
-	    int dirType = isDirective(segments->operation);
 
-	    if (isStartDirective(dirType)) {
-	        addresses->start = addresses->current = strtol(segments->operand, NULL, 16);
-	        continue;
-	    }
+// Rebuilds the assembly after the source changed and rewrites the output files
+// When only instruction operands changed, the Symbol Table and addresses stay valid, so Pass 1 is
+// skipped and only the changed Format 3/4 instructions are encoded again
+// The new assembly is built in the empty next assembly, which the watch loop frees when an error ends the
+// rebuild, and is only moved into the resident state once it is complete
+void reassembleSource(char* filename, options* settings, assembly* state, assembly* next)
+{
+	lineStream* lines = &next->lines;
+	address location = state->addresses;
+	int rsubId = internName("RSUB");
 
-	    if (dirType) {
-	        addresses->increment = getMemoryAmount(dirType, segments->operand);
-	    } else if (isOpcode(segments->operation)) {
-	        addresses->increment = getOpcodeFormat(segments->operation);
-	    } else {
-	        displayError(ILLEGAL_OPCODE_DIRECTIVE, segments->operation);
-	        exit(-1);
-	    }
+	beginIncludeRecord();
+	readLineStream(filename, lines);
 
-	    if (strlen(segments->label) > 0) {
-	        insertSymbol(symbolTable, segments->label, addresses->current);
-	    }
+	// Relaxation can move any address when an operand changes, so --optimize always rebuilds
+	if (settings->optimize || !hasSameLayout(&state->lines, lines))
+	{
+		freeLineStream(lines);
+		memset(&next->addresses, 0, sizeof(address));
+		assembleSource(filename, settings, next);
+		freeAssembly(state);
+		*state = *next;
+		memset(next, 0, sizeof(assembly));
+		return;
+	}
+
+	next->encodings = (int*)malloc(sizeof(int) * (lines->count + 1));
+	memcpy(next->encodings, state->encodings, sizeof(int) * lines->count);
+	location.base = 0;
+
+	for (int x = 0; x < lines->count; x++)
+	{
+		segment* seg = &lines->lines[x].segments;
+		int directiveType = getDirectiveType(lines->lines[x].operationId);
+
+		lines->lines[x].address = state->lines.lines[x].address;
+		setErrorLocation(getName(lines->lines[x].fileId), lines->lines[x].lineNumber);
+		if (isBaseDirective(directiveType))
+		{
+			location.base = getSymbolAddress(&state->symbols, lines->lines[x].symbolId);
+			continue;
+		}
 
-	    addresses->current += addresses->increment;
-	    memset(line, '\0', INPUT_BUF_SIZE);
+		int format = getOperandFormat(&lines->lines[x], rsubId);
+		if (format && strcmp(seg->operand, state->lines.lines[x].segments.operand) != 0)
+		{
+			location.current = lines->lines[x].address;
+			next->encodings[x] = computeFlagsAndAddress(&state->symbols, &location, &lines->lines[x], format);
+		}
 	}
-	fclose(file);
+
+	setErrorLocation(NULL, 0);
+
+	performPass2(&state->symbols, filename, &state->addresses, lines, next->encodings, settings, NULL);
+
+	freeLineStream(&state->lines);
+	free(state->encodings);
+	state->lines = *lines;
+	state->encodings = next->encodings;
+	memset(next, 0, sizeof(assembly));
+
+	// The debug index is built from the new lines, whose line numbers may have moved
+	writeDebugOutputs(filename, settings, state);
 }
 
-// Performs Pass 2 of the SIC/XE assembler
-void performPass2(symbol* symbolTable[], char* filename, address* addresses)
+// Chooses the smallest valid encoding for each Format 3/4 instruction that does not use '+'
+// Every such instruction starts as Format 3; the instructions that cannot reach their target
+// with PC- or BASE-relative addressing grow to Format 4 and the addresses are recomputed.
+// Instructions only ever grow, so the relaxation converges after a few linear passes.
+void relaxFormats(symbolTable* symbols, address* addresses, lineStream* lines)
 {
-    int execAddr = addresses->start;
+	int* sizes = (int*)malloc(sizeof(int) * (lines->count + 1));
+	symbol** labels = (symbol**)malloc(sizeof(symbol*) * (lines->count + 1));
+	symbol** targets = (symbol**)malloc(sizeof(symbol*) * (lines->count + 1));
+	char symbolName[SEGMENT_SIZE];
+	int rsubId = internName("RSUB");
+	bool changed = true;
+
+	for (int x = 0; x < lines->count; x++)
+	{
+		segment* seg = &lines->lines[x].segments;
+		int directiveType = getDirectiveType(lines->lines[x].operationId);
 
-    char* lstName = createFilename(filename, ".lst");
-    char* objName = createFilename(filename, ".obj");
-    FILE* lst = fopen(lstName, "w");
-    FILE* obj = fopen(objName, "w+");  // opened in "w+" mode for read/write
+		labels[x] = findSymbol(symbols, lines->lines[x].labelId);
+		targets[x] = NULL;
 
-    if (!lst || !obj) {
-        displayError(FILE_NOT_FOUND, filename);
-        exit(-1);
-    }
+		if (directiveType)
+		{
+			sizes[x] = getMemoryAmount(directiveType, seg->operand);
+			continue;
+		}
 
-    objectFileData hdr = {0};
-    hdr.recordType = 'H';
+		// Instructions written with '+' start in Format 3 like the others and only keep Format 4 when they
+		// cannot reach their target; Pass 1 has already rejected '+' on Format 1 and 2 opcodes
+		sizes[x] = getOpcodeFormatById(lines->lines[x].operationId);
+		sizes[x] = sizes[x] == FORMAT_4 ? FORMAT_3 : sizes[x];
+		if (sizes[x] != FORMAT_3 || lines->lines[x].operationId == rsubId)
+		{
+			continue;
+		}
 
-    objectFileData txt = {0};
-    txt.recordType = 'T';
+		if (isConstantMode(classifyAddressing(seg->operand, FORMAT_3, symbolName)))
+		{
+			// Constants that do not fit the 12-bit displacement always need Format 4
+			if (strtol(symbolName, NULL, 10) > FORMAT_3_MAX_CONSTANT)
+			{
+				sizes[x] = FORMAT_4;
+			}
+			continue;
+		}
 
-    FILE* src = fopen(filename, "r");
-    char line[INPUT_BUF_SIZE];
+		// Unknown symbols are left for Pass 2 to report
+		targets[x] = findSymbol(symbols, lines->lines[x].symbolId);
+	}
 
-    bool startSeen = false;
-    addresses->current = addresses->start;
+	while (changed)
+	{
+		// As in Pass 2, BASE-relative addressing uses a base of 0 until the first BASE directive
+		int base = 0;
+		changed = false;
 
-    // First pass to extract header values
-    while (fgets(line, sizeof line, src)) {
-        if (line[0] < 32 || line[0] == COMMENT) continue;
+		// Assign addresses and symbol values using the current instruction sizes
+		addresses->current = addresses->start;
+		for (int x = 0; x < lines->count; x++)
+		{
+			segment* seg = &lines->lines[x].segments;
+			if (isStartDirective(getDirectiveType(lines->lines[x].operationId)))
+			{
+				addresses->start = addresses->current = strtol(seg->operand, NULL, 16);
+			}
+			lines->lines[x].address = addresses->current;
+			if (labels[x] != NULL)
+			{
+				labels[x]->address = addresses->current;
+			}
+			addresses->current += sizes[x];
+		}
 
-        segment* seg = prepareSegments(line);
-        int dtype = isDirective(seg->operation);
+		// Grow the Format 3 instructions that can no longer reach their target
+		for (int x = 0; x < lines->count; x++)
+		{
+			if (isBaseDirective(getDirectiveType(lines->lines[x].operationId)))
+			{
+				symbol* baseSymbol = findSymbol(symbols, lines->lines[x].symbolId);
+				if (baseSymbol != NULL)
+				{
+					base = baseSymbol->address;
+				}
+			}
+			else if (targets[x] != NULL && sizes[x] == FORMAT_3 &&
+					!isFormat3Reachable(lines->lines[x].address, targets[x]->address, base))
+			{
+				sizes[x] = FORMAT_4;
+				changed = true;
+			}
+		}
+	}
 
-        if (isStartDirective(dtype) && !startSeen) {
-            startSeen = true;
-            hdr.startAddress = strtol(seg->operand, NULL, 16);
-            addresses->start = hdr.startAddress;
-            addresses->current = hdr.startAddress;
-            strncpy(hdr.programName, seg->label, NAME_SIZE - 1);
-            break;
-        }
-    }
+	if (addresses->current >= 0x100000)
+	{
+		char value[12];
+		sprintf(value, "0x%X", addresses->current);
+		displayError(OUT_OF_MEMORY, value);
+		exit(-1);
+	}
 
-    // Reserve space for header record
-    fseek(obj, 40, SEEK_SET); // skip room for 1 header line of about ~40 characters
+	// Add or drop the '+' of each instruction whose format changed so Pass 2 encodes it in the chosen format
+	for (int x = 0; x < lines->count; x++)
+	{
+		segment* seg = &lines->lines[x].segments;
+		if (getDirectiveType(lines->lines[x].operationId))
+		{
+			continue;
+		}
+		if (sizes[x] == FORMAT_4 && seg->operation[0] != '+')
+		{
+			memmove(&seg->operation[1], seg->operation, strlen(seg->operation) + 1);
+			seg->operation[0] = '+';
+		}
+		else if (sizes[x] == FORMAT_3 && seg->operation[0] == '+')
+		{
+			memmove(seg->operation, &seg->operation[1], strlen(seg->operation));
+		}
+		else
+		{
+			continue;
+		}
+		lines->lines[x].operationId = internName(seg->operation);
+		lines->lines[x].relaxed = true;
+	}
+
+	free(sizes);
+	free(labels);
+	free(targets);
+}
+
+// Determines the addressing mode of a Format 3/4 operand and resolves the symbol or constant it refers to
+// Returns the target address or constant value, and stores the index of the addressing mode template
+int resolveOperand(symbolTable* symbols, sourceLine* line, int format, int* mode)
+{
+	char symbolName[SEGMENT_SIZE];
+
+	*mode = classifyAddressing(line->segments.operand, format, symbolName);
+	return isConstantMode(*mode) ? strtol(symbolName, NULL, 10) : getSymbolAddress(symbols, line->symbolId);
+}
+
+// Assembles the source file, then keeps the assembly resident and reassembles it each time the
+// source or a file it includes changes; this function does not return
+// An error in the source is reported and the previous output files are left in place
+void watchSource(char* filename, options* settings, assembly* state)
+{
+	struct timespec started, finished;
+	jmp_buf recovery;
+	watchList watches;
+	assembly next = { 0 };
+
+	initializeWatch(&watches);
+	addWatch(&watches, filename);
+
+	setErrorRecovery(&recovery);
+	if (setjmp(recovery) == 0)
+	{
+		assembleSource(filename, settings, state);
+		printf("Assembled %s. Watching for changes.\n", filename);
+	}
+	else
+	{
+		freeAssembly(state);
+	}
+	fflush(stdout);
 
-    rewind(src);
-    txt.recordAddress = addresses->current;
+	while (true)
+	{
+		// Files included by the last assembly are watched too; a file that is no longer included stays watched
+		for (includedFile* file = getIncludedFiles(); file != NULL; file = file->next)
+		{
+			addWatch(&watches, getName(file->nameId));
+		}
+		waitForChange(&watches);
+		clock_gettime(CLOCK_MONOTONIC, &started);
 
-    while (fgets(line, sizeof line, src)) {
-        if (line[0] < 32 || line[0] == COMMENT) continue;
+		if (setjmp(recovery) == 0)
+		{
+			reassembleSource(filename, settings, state, &next);
+			clock_gettime(CLOCK_MONOTONIC, &finished);
+			printf("Reassembled %s in %.3f ms.\n", filename,
+					(finished.tv_sec - started.tv_sec) * 1000.0 + (finished.tv_nsec - started.tv_nsec) / 1000000.0);
+		}
+		else
+		{
+			// The resident state may be incomplete, so the next change is assembled from scratch
+			freeAssembly(state);
+			freeAssembly(&next);
+		}
+		fflush(stdout);
+	}
+}
 
-        segment* seg = prepareSegments(line);
-        int dtype = isDirective(seg->operation);
+// Writes the .dbg index and prints the Symbol Table when those options are selected
+void writeDebugOutputs(char* filename, options* settings, assembly* state)
+{
+	debugInfo info;
 
+	if (!settings->debugInfo && !settings->symbols)
+	{
+		return;
+	}
+
+	buildDebugInfo(&state->symbols, &state->lines, &info);
+	if (settings->debugInfo)
+	{
+		char* debugName = createFilename(filename, ".dbg");
+		writeDebugInfo(debugName, &info);
+		free(debugName);
+	}
+	if (settings->symbols)
+	{
+		displayDebugSymbols(&info);
+	}
+	freeDebugInfo(&info);
+}
+
+// Writes the object code and listing of a range of the line stream, in order
+// firstLine is the index of the first line of the range within the whole line stream
+void writePass2Lines(pass2Output* out, symbolTable* symbols, address* addresses, lineStream* lines, int* encodings, int firstLine)
+{
+    out->lst.firstLine = firstLine;
+
+    for (int x = 0; x < lines->count; x++) {
+        segment* seg = &lines->lines[x].segments;
+        int dtype = getDirectiveType(lines->lines[x].operationId);
+
+        if (out->stages != NULL) {
+            awaitEncodedLine(out->stages, firstLine + x);
+        }
+        setErrorLocation(getName(lines->lines[x].fileId), lines->lines[x].lineNumber);
         if (isStartDirective(dtype)) {
             int addr = strtol(seg->operand, NULL, 16);
+            if (!out->started) {
+                out->hdr.startAddress = addr;
+                strncpy(out->hdr.programName, seg->label, NAME_SIZE - 1);
+                out->started = true;
+            }
             addresses->start = addr;
             addresses->current = addr;
-            txt.recordAddress = addr;
-            writeToLstFile(lst, addresses->current, seg, 0);
+            out->txt.recordAddress = addr;
+            writeListingLine(&out->lst, addresses->current, lines, x, 0);
             continue;
         }
 
         if (isEndDirective(dtype)) {
             if (seg->operand[0] != '\0') {
-                execAddr = getSymbolAddress(symbolTable, seg->operand);
+                out->execAddr = getSymbolAddress(symbols, lines->lines[x].symbolId);
             }
-            writeToLstFile(lst, addresses->current, seg, 0);
+            writeListingLine(&out->lst, addresses->current, lines, x, 0);
             continue;
         }
 
         if (isBaseDirective(dtype)) {
-            addresses->base = getSymbolAddress(symbolTable, seg->operand);
-            writeToLstFile(lst, addresses->current, seg, 0);
+            addresses->base = getSymbolAddress(symbols, lines->lines[x].symbolId);
+            writeListingLine(&out->lst, addresses->current, lines, x, 0);
             continue;
         }
 
         if (isReserveDirective(dtype)) {
-            if (txt.recordEntryCount > 0) {
-                flushTextRecord(obj, &txt, addresses);
-                txt.recordType = 'T';
+            // The packer decides whether to fill the gap when the next object code arrives
+            if (out->txt.recordEntryCount > 0 && !out->settings->packLimit) {
+                flushTextRecord(out->obj, &out->txt, addresses);
+                out->txt.recordType = 'T';
             }
-            writeToLstFile(lst, addresses->current, seg, 0);
+            writeListingLine(&out->lst, addresses->current, lines, x, 0);
             addresses->current += getMemoryAmount(dtype, seg->operand);
-            txt.recordAddress = addresses->current; // 🟢 FIX HERE
+            out->txt.recordAddress = addresses->current;
             continue;
         }
 
@@ -405,144 +1197,69 @@ void performPass2(symbol* symbolTable[], char* filename, address* addresses)
                 nbytes = getMemoryAmount(dtype, seg->operand);
             }
 
-            if (txt.recordByteCount + nbytes > MAX_RECORD_BYTE_COUNT) {
-                if (txt.recordEntryCount > 0) {
-                    flushTextRecord(obj, &txt, addresses);
-                    txt.recordType = 'T';
-                    txt.recordAddress = addresses->current;
+            if (out->settings->packLimit) {
+                packBytes(&out->packer, addresses->current, code, nbytes);
+            } else {
+                if (out->txt.recordByteCount + nbytes > MAX_RECORD_BYTE_COUNT) {
+                    if (out->txt.recordEntryCount > 0) {
+                        flushTextRecord(out->obj, &out->txt, addresses);
+                        out->txt.recordType = 'T';
+                        out->txt.recordAddress = addresses->current;
+                    }
                 }
-            }
 
-            txt.recordEntries[txt.recordEntryCount++] = (recordEntry){ nbytes, code };
-            txt.recordByteCount += nbytes;
+                out->txt.recordEntries[out->txt.recordEntryCount++] = (recordEntry){ nbytes, code };
+                out->txt.recordByteCount += nbytes;
+            }
 
-            writeToLstFile(lst, addresses->current, seg, code);
+            writeListingLine(&out->lst, addresses->current, lines, x, code);
             addresses->current += nbytes;
             continue;
         }
 
-        if (isOpcode(seg->operation)) {
-            int fmt = getOpcodeFormat(seg->operation);
+        if (getOpcodeValueById(lines->lines[x].operationId) >= 0) {
+            int fmt = getOpcodeFormatById(lines->lines[x].operationId);
             int objCode = 0, nbytes = 0;
 
-            if (strcmp(seg->operation, "RSUB") == 0) {
+            if (lines->lines[x].operationId == out->rsubId) {
                 objCode = 0x4F0000;
                 nbytes = 3;
                 seg->operand[0] = '\0';
             } else if (fmt == FORMAT_1) {
-                objCode = getOpcodeValue(seg->operation) & 0xFF;
+                objCode = getOpcodeValueById(lines->lines[x].operationId) & 0xFF;
                 nbytes = 1;
             } else if (fmt == FORMAT_2) {
                 int regs = getRegisters(seg->operand) & 0xFF;
-                objCode = ((getOpcodeValue(seg->operation) & 0xFF) << 8) | regs;
+                objCode = ((getOpcodeValueById(lines->lines[x].operationId) & 0xFF) << 8) | regs;
                 nbytes = 2;
             } else {
-                objCode = computeFlagsAndAddress(symbolTable, addresses, seg, (fmt == FORMAT_4 ? FORMAT_4 : FORMAT_3));
+                objCode = encodings[x];
                 nbytes = (fmt == FORMAT_4 ? 4 : 3);
             }
 
-            if (txt.recordByteCount + nbytes > MAX_RECORD_BYTE_COUNT) {
-                if (txt.recordEntryCount > 0) {
-                    flushTextRecord(obj, &txt, addresses);
-                    txt.recordType = 'T';
-                    txt.recordAddress = addresses->current;
+            if (out->settings->packLimit) {
+                packBytes(&out->packer, addresses->current, objCode, nbytes);
+            } else {
+                if (out->txt.recordByteCount + nbytes > MAX_RECORD_BYTE_COUNT) {
+                    if (out->txt.recordEntryCount > 0) {
+                        flushTextRecord(out->obj, &out->txt, addresses);
+                        out->txt.recordType = 'T';
+                        out->txt.recordAddress = addresses->current;
+                    }
                 }
-            }
 
-            txt.recordEntries[txt.recordEntryCount++] = (recordEntry){ nbytes, objCode };
-            txt.recordByteCount += nbytes;
+                out->txt.recordEntries[out->txt.recordEntryCount++] = (recordEntry){ nbytes, objCode };
+                out->txt.recordByteCount += nbytes;
+            }
 
-            writeToLstFile(lst, addresses->current, seg, objCode);
+            writeListingLine(&out->lst, addresses->current, lines, x, objCode);
             addresses->current += nbytes;
             continue;
         }
 
-        writeToLstFile(lst, addresses->current, seg, 0);
+        writeListingLine(&out->lst, addresses->current, lines, x, 0);
     }
 
-    fclose(src);
-
-    if (txt.recordEntryCount > 0) {
-        flushTextRecord(obj, &txt, addresses);
-    }
-
-    hdr.programSize = addresses->current - hdr.startAddress;
-
-    // Seek back to top and write the header now that size is known
-    fseek(obj, 0, SEEK_SET);
-    writeToObjFile(obj, hdr);
-
-    objectFileData endRec = {0};
-    endRec.recordType = 'E';
-    endRec.startAddress = execAddr;
-    fseek(obj, 0, SEEK_END);
-    writeToObjFile(obj, endRec);
-
-    fclose(lst);
-    fclose(obj);
-}
-
-
-// Do no modify any part of this function
-// Separates a SIC/XE instruction into individual sections
-segment* prepareSegments(char* statement)
-{
-	segment* temp = malloc(sizeof(segment));
-	strncpy(temp->label, statement, SEGMENT_SIZE - 1);
-	strncpy(temp->operation, statement + SEGMENT_SIZE - 1, SEGMENT_SIZE - 1);
-	strncpy(temp->operand, statement + (SEGMENT_SIZE - 1) * 2, SEGMENT_SIZE - 1);
-	trim(temp->label);
-	trim(temp->operation);
-	trim(temp->operand);
-	return temp;
-}
-
-// Do no modify any part of this function
-// Removes spaces from the end of a segment value
-void trim(char value[])
-{
-	for (int x = 0; x < SEGMENT_SIZE; x++)
-	{
-		if (value[x] == SPACE)
-		{
-			value[x] = '\0';
-		}
-	}
-}
-
-// Do no modify any part of this function
-// Write SIC/XE instructions along with address and object code information of source code listing file
-void writeToLstFile(FILE* file, int address, segment* segments, int opcode)
-{
-	char ctrlString[27];
-	int length;
-
-	int directiveType = isDirective(segments->operation);
-
-	if (isStartDirective(directiveType) ||
-			isBaseDirective(directiveType) ||
-			isReserveDirective(directiveType))
-	{
-		fprintf(file, "%-8X%-8s%-8s%-11s\n", address, segments->label, segments->operation, segments->operand);
-	}
-	else if (isEndDirective(directiveType))
-	{
-		fprintf(file, "%-8X%-8s%-8s%-11s", address, segments->label, segments->operation, segments->operand);
-	}
-	else
-	{
-		if (isDataDirective(directiveType))
-		{
-			length = getMemoryAmount(directiveType, segments->operand) * 2;
-		}
-		else
-		{
-			length = getOpcodeFormat(segments->operation) * 2;
-		}
-		sprintf(ctrlString, "%%-8X%%-8s%%-8s%%-11s %%0%dX\n", length);
-
-		fprintf(file, ctrlString, address, segments->label, segments->operation, segments->operand, opcode);
-	}
 }
 
 // Do no modify any part of this function
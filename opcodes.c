@@ -7,7 +7,7 @@
  *        DO NOT REMOVE THIS MESSAGE
  **********************************************/
 
-#include "headers.h"
+#include "assembler.h"
 
 #define OPCODE_ARRAY_SIZE 50
 
@@ -18,6 +18,13 @@ typedef struct opcode
 	int value;
 } opcode;
 
+// Used to store the format and value of an interned name as getOpcodeFormat and getOpcodeValue return them
+typedef struct opcodeName
+{
+	int format;
+	int value;  // -1 for names that are not opcodes
+} opcodeName;
+
 bool isFormat4Instruction(char* opcode);
 int searchOpcodes(char* opcode);
 
@@ -39,6 +46,23 @@ opcode opcodes[OPCODE_ARRAY_SIZE] = {
 		{"TIXR",2,0xB8},{"WD",3,0xDC}
 };
 
+// Format and value of each interned name ID below opcodeIdCount
+opcodeName* opcodeNames = NULL;
+int opcodeIdCount = 0;
+
+// Returns the name of the opcode at the provided index of the opcodes array and stores its
+// format and value; otherwise, NULL (index past the end of the array)
+char* getOpcodeEntry(int index, int* format, int* value)
+{
+	if (index < 0 || index >= OPCODE_ARRAY_SIZE)
+	{
+		return NULL;
+	}
+	*format = opcodes[index].format;
+	*value = opcodes[index].value;
+	return opcodes[index].name;
+}
+
 // Do no modify any part of this function
 // Returns the format of the provided opcode
 int getOpcodeFormat(char* opcode)
@@ -67,6 +91,12 @@ int getOpcodeFormat(char* opcode)
 	}
 }
 
+// Returns the format of the opcode with the provided interned name; otherwise, 0
+int getOpcodeFormatById(int nameId)
+{
+	return nameId >= 0 && nameId < opcodeIdCount && opcodeNames[nameId].value >= 0 ? opcodeNames[nameId].format : 0;
+}
+
 // Do no modify any part of this function
 // Returns the value of the provided opcode; otherwise; -1
 int getOpcodeValue(char* opcode)
@@ -84,6 +114,53 @@ int getOpcodeValue(char* opcode)
 	return -1; // Should not happen
 }
 
+// Returns the value of the opcode with the provided interned name; otherwise, -1
+int getOpcodeValueById(int nameId)
+{
+	return nameId >= 0 && nameId < opcodeIdCount ? opcodeNames[nameId].value : -1;
+}
+
+// Returns true if the operation marks a Format 1 or 2 opcode as Format 4 with '+'; otherwise, false
+// getOpcodeFormat returns 4 for '+' on any opcode, so the format of the opcode itself is looked up
+bool isIllegalFormat4(char* operation)
+{
+	return operation[0] == '+' && getOpcodeFormat(operation + 1) != FORMAT_3;
+}
+
+// Interns the name of every opcode, with and without the '+' of Format 4, and records its format and value
+// by name ID
+// Called once before any source is lexed, so the table is never written while a pipeline stage reads it
+void internOpcodes(void)
+{
+	int ids[OPCODE_ARRAY_SIZE * 2];
+	char extended[NAME_SIZE + 1];
+
+	for (int x = 0; x < OPCODE_ARRAY_SIZE; x++)
+	{
+		extended[0] = '+';
+		strcpy(extended + 1, opcodes[x].name);
+		ids[x * 2] = internName(opcodes[x].name);
+		ids[x * 2 + 1] = internName(extended);
+		for (int y = x * 2; y <= x * 2 + 1; y++)
+		{
+			opcodeIdCount = ids[y] >= opcodeIdCount ? ids[y] + 1 : opcodeIdCount;
+		}
+	}
+
+	opcodeNames = (opcodeName*)malloc(sizeof(opcodeName) * opcodeIdCount);
+	for (int x = 0; x < opcodeIdCount; x++)
+	{
+		opcodeNames[x].format = 0;
+		opcodeNames[x].value = -1;
+	}
+	for (int x = 0; x < OPCODE_ARRAY_SIZE * 2; x++)
+	{
+		char* name = getName(ids[x]);
+		opcodeNames[ids[x]].format = getOpcodeFormat(name);
+		opcodeNames[ids[x]].value = getOpcodeValue(name);
+	}
+}
+
 // Do no modify any part of this function
 // Tests whether the provided opcode is extended (contains a '+' sign)
 // Returns true if format 4; otherwise, false
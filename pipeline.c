@@ -0,0 +1,325 @@
+// Threads of --pipeline: the lexer thread feeds Pass 1, the encoder thread encodes ahead of Pass 2, and the
+// writer thread writes the output files behind it; Pass 1 and Pass 2 formatting run on the calling thread
+//
+// Reading and lexing share the lexer thread rather than being two stages. openSourceReader reads the whole
+// source with one fread, or takes the buffer --async-io read ahead, and an included file is read once by
+// lexIncludedFile when the lexer reaches its INCLUDE. A read stage would therefore hand over a single buffer
+// before any line could be lexed, and would overlap with nothing.
+//
+// Pass 2 formatting stays on the calling thread, which has no other work once Pass 1 ends, so it is already
+// a stage of its own between the encoder and writer threads. Moving it to another thread would only leave
+// the calling thread waiting for it, and the Text record and listing state it updates would have to be
+// handed across as well.
+#define _GNU_SOURCE
+#include "assembler.h"
+#include <fcntl.h>
+#include <stddef.h>
+#include <sched.h>
+#include <unistd.h>
+
+int closeOutput(void* cookie);
+void freeRing(batchRing* ring);
+void initializeRing(batchRing* ring, size_t slotSize);
+void* lexSource(void* argument);
+void* nextBatch(batchRing* ring);
+void publishChunk(outputFile* output);
+void releaseBatch(batchRing* ring);
+int seekOutput(void* cookie, off64_t* offset, int whence);
+void* writeChunks(void* argument);
+ssize_t writeOutput(void* cookie, const char* buffer, size_t size);
+
+// Waits until the encoder thread has encoded the Format 3/4 instructions up to the provided line
+void awaitEncodedLine(pipeline* stages, int lineIndex)
+{
+	while (lineIndex >= stages->encodedThrough)
+	{
+		lineRange* range = (lineRange*)nextBatch(&stages->encoded);
+		if (range == NULL)
+		{
+			return;
+		}
+		stages->encodedThrough = range->first + range->count;
+		releaseBatch(&stages->encoded);
+	}
+}
+
+// Returns the next empty slot of the ring, waiting while the consumer is a full ring behind
+void* claimSlot(batchRing* ring)
+{
+	unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+	while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == PIPELINE_RING_SIZE)
+	{
+		sched_yield();
+	}
+	return ring->slots + (tail & (PIPELINE_RING_SIZE - 1)) * ring->slotSize;
+}
+
+// Hands the rest of an output file to the writer thread and has it close the file
+int closeOutput(void* cookie)
+{
+	outputFile* output = (outputFile*)cookie;
+
+	publishChunk(output);
+	output->chunk.length = -1;
+	publishChunk(output);
+	free(output);
+	return 0;
+}
+
+// Tells the consumer that no more batches will be published
+void closeRing(batchRing* ring)
+{
+	atomic_store_explicit(&ring->closed, true, memory_order_release);
+}
+
+// Waits for the stage threads to finish and releases the pipeline
+// Every output file must be closed first so the writer thread has received all of its chunks
+void finishPipeline(pipeline* stages)
+{
+	closeRing(&stages->written);
+	pthread_join(stages->lexer, NULL);
+	pthread_join(stages->encoder, NULL);
+	pthread_join(stages->writer, NULL);
+
+	freeRing(&stages->lexed);
+	freeRing(&stages->encoded);
+	freeRing(&stages->written);
+	free(stages);
+}
+
+// Releases the slots of the ring
+void freeRing(batchRing* ring)
+{
+	free(ring->slots);
+	ring->slots = NULL;
+}
+
+// Prepares an empty ring of PIPELINE_RING_SIZE slots of the provided size
+void initializeRing(batchRing* ring, size_t slotSize)
+{
+	ring->slots = (unsigned char*)malloc(slotSize * PIPELINE_RING_SIZE);
+	ring->slotSize = slotSize;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->closed, false);
+}
+
+// Lexer thread: reads the source file and hands its lexed, macro-expanded lines to Pass 1 in batches
+void* lexSource(void* argument)
+{
+	pipeline* stages = (pipeline*)argument;
+	lineBatch* batch = (lineBatch*)claimSlot(&stages->lexed);
+	sourceReader reader;
+
+	openSourceReader(&reader, stages->filename);
+	batch->count = 0;
+	while (nextSourceLine(&reader, &batch->lines[batch->count]))
+	{
+		if (++batch->count == PIPELINE_BATCH_SIZE)
+		{
+			publishSlot(&stages->lexed);
+			batch = (lineBatch*)claimSlot(&stages->lexed);
+			batch->count = 0;
+		}
+	}
+	if (batch->count > 0)
+	{
+		publishSlot(&stages->lexed);
+	}
+	closeRing(&stages->lexed);
+	closeSourceReader(&reader);
+	return NULL;
+}
+
+// Returns the oldest published batch of the ring, waiting while the ring is empty
+// Returns NULL once the ring is closed and every batch has been read
+void* nextBatch(batchRing* ring)
+{
+	unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	while (head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+	{
+		// The producer publishes its last batch before it closes the ring, so check the tail again
+		if (atomic_load_explicit(&ring->closed, memory_order_acquire))
+		{
+			if (head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+			{
+				return NULL;
+			}
+			break;
+		}
+		sched_yield();
+	}
+	return ring->slots + (head & (PIPELINE_RING_SIZE - 1)) * ring->slotSize;
+}
+
+// Returns the next line lexed by the lexer thread
+// Returns false once the end of the source file is reached
+bool nextLexedLine(pipeline* stages, sourceLine* line)
+{
+	while (stages->lexedBatch == NULL || stages->lexedIndex == stages->lexedBatch->count)
+	{
+		if (stages->lexedBatch != NULL)
+		{
+			releaseBatch(&stages->lexed);
+		}
+		if ((stages->lexedBatch = (lineBatch*)nextBatch(&stages->lexed)) == NULL)
+		{
+			return false;
+		}
+		stages->lexedIndex = 0;
+	}
+	*line = stages->lexedBatch->lines[stages->lexedIndex++];
+	return true;
+}
+
+// Opens an output file of Pass 2; in a pipeline, the file is written by the writer thread
+// Returns the file; otherwise, NULL
+FILE* openOutputFile(char* filename, char* mode, pipeline* stages)
+{
+	cookie_io_functions_t functions = { NULL, writeOutput, seekOutput, closeOutput };
+	outputFile* output;
+	FILE* buffered;
+	int descriptor;
+
+	// Without a pipeline, asynchronous I/O writes the file behind the assembly when it is in use
+	if (stages == NULL)
+	{
+		buffered = openBufferedOutput(filename, mode);
+		return buffered != NULL ? buffered : fopen(filename, mode);
+	}
+
+	descriptor = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (descriptor < 0)
+	{
+		return NULL;
+	}
+	output = (outputFile*)calloc(1, sizeof(outputFile));
+	output->stages = stages;
+	output->descriptor = descriptor;
+	output->chunk.descriptor = descriptor;
+	return fopencookie(output, mode, functions);
+}
+
+// Hands the chunk being filled, if it is not empty, to the writer thread
+void publishChunk(outputFile* output)
+{
+	outputChunk* chunk = &output->chunk;
+
+	if (chunk->length != 0)
+	{
+		memcpy(claimSlot(&output->stages->written), chunk, offsetof(outputChunk, data) + (chunk->length > 0 ? chunk->length : 0));
+		publishSlot(&output->stages->written);
+		chunk->length = 0;
+	}
+}
+
+// Makes the slot returned by claimSlot visible to the consumer
+void publishSlot(batchRing* ring)
+{
+	atomic_store_explicit(&ring->tail, atomic_load_explicit(&ring->tail, memory_order_relaxed) + 1, memory_order_release);
+}
+
+// Returns the slot returned by nextBatch to the producer
+void releaseBatch(batchRing* ring)
+{
+	atomic_store_explicit(&ring->head, atomic_load_explicit(&ring->head, memory_order_relaxed) + 1, memory_order_release);
+}
+
+// Moves the position of an output file; the next write starts a new chunk at that position
+int seekOutput(void* cookie, off64_t* offset, int whence)
+{
+	outputFile* output = (outputFile*)cookie;
+	off64_t position = *offset;
+
+	if (whence == SEEK_CUR)
+	{
+		position += output->position;
+	}
+	else if (whence == SEEK_END)
+	{
+		position += output->size;
+	}
+	if (position < 0)
+	{
+		return -1;
+	}
+	output->position = *offset = position;
+	return 0;
+}
+
+// Starts the lexer and writer threads of a pipelined assembly of the source file
+// The encoder thread is started once Pass 1 has completed the Symbol Table
+pipeline* startPipeline(char* filename, struct assembly* state)
+{
+	pipeline* stages = (pipeline*)calloc(1, sizeof(pipeline));
+
+	stages->filename = filename;
+	stages->state = state;
+	initializeRing(&stages->lexed, sizeof(lineBatch));
+	initializeRing(&stages->encoded, sizeof(lineRange));
+	initializeRing(&stages->written, sizeof(outputChunk));
+
+	pthread_create(&stages->lexer, NULL, lexSource, stages);
+	pthread_create(&stages->writer, NULL, writeChunks, stages);
+	return stages;
+}
+
+// Writer thread: writes each chunk of output at its offset and closes each file once it is complete
+void* writeChunks(void* argument)
+{
+	pipeline* stages = (pipeline*)argument;
+	outputChunk* chunk;
+
+	while ((chunk = (outputChunk*)nextBatch(&stages->written)) != NULL)
+	{
+		if (chunk->length < 0)
+		{
+			close(chunk->descriptor);
+		}
+		for (int written = 0, count; written < chunk->length; written += count)
+		{
+			count = pwrite(chunk->descriptor, chunk->data + written, chunk->length - written, chunk->offset + written);
+			if (count <= 0)
+			{
+				displayError(FILE_NOT_FOUND, stages->filename);
+				exit(-1);
+			}
+		}
+		releaseBatch(&stages->written);
+	}
+	return NULL;
+}
+
+// Copies formatted output into chunks for the writer thread
+// Returns the number of bytes accepted, which is always all of them
+ssize_t writeOutput(void* cookie, const char* buffer, size_t size)
+{
+	outputFile* output = (outputFile*)cookie;
+	size_t copied = 0;
+
+	while (copied < size)
+	{
+		outputChunk* chunk = &output->chunk;
+		if (chunk->length == PIPELINE_CHUNK_SIZE || chunk->offset + chunk->length != output->position)
+		{
+			publishChunk(output);
+		}
+		if (chunk->length == 0)
+		{
+			chunk->offset = output->position;
+		}
+
+		int count = size - copied < (size_t)(PIPELINE_CHUNK_SIZE - chunk->length) ? (int)(size - copied) : PIPELINE_CHUNK_SIZE - chunk->length;
+		memcpy(chunk->data + chunk->length, buffer + copied, count);
+		chunk->length += count;
+		output->position += count;
+		copied += count;
+	}
+	if (output->position > output->size)
+	{
+		output->size = output->position;
+	}
+	return size;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#define PIPELINE_BATCH_SIZE 256      // Lines in a batch handed between two stages
+#define PIPELINE_CHUNK_SIZE 65536    // Bytes of output in a chunk handed to the writer thread
+#define PIPELINE_RING_SIZE 16        // Batches in flight between two stages; a power of two
+
+// Used to hand batches from exactly one producer thread to exactly one consumer thread without locks
+// Each side only advances its own index, and a release store of the index publishes the slot
+typedef struct batchRing {
+	unsigned char* slots;
+	size_t slotSize;
+	atomic_uint head;            // Next slot the consumer reads
+	atomic_uint tail;            // Next slot the producer fills
+	atomic_bool closed;          // The producer has published its last batch
+} batchRing;
+
+// Used to hand lexed lines from the lexer thread to Pass 1
+typedef struct lineBatch {
+	sourceLine lines[PIPELINE_BATCH_SIZE];
+	int count;
+} lineBatch;
+
+// Used to tell Pass 2 that the Format 3/4 instructions of a range of lines are encoded
+typedef struct lineRange {
+	int first;
+	int count;
+} lineRange;
+
+// Used to hand formatted output from Pass 2 to the writer thread
+typedef struct outputChunk {
+	int descriptor;
+	off_t offset;
+	int length;                  // -1 once the file is complete and can be closed
+	char data[PIPELINE_CHUNK_SIZE];
+} outputChunk;
+
+// Used to run the stages of one assembly on separate threads: lexing, Pass 1, encoding,
+// Pass 2 formatting and writing. Pass 1 and Pass 2 run on the calling thread.
+typedef struct pipeline {
+	char* filename;
+	struct assembly* state;
+	batchRing lexed;             // Lexer thread to Pass 1
+	batchRing encoded;           // Encoder thread to Pass 2
+	batchRing written;           // Pass 2 to writer thread
+	lineBatch* lexedBatch;       // Batch Pass 1 is reading; NULL before the first batch
+	int lexedIndex;
+	int encodedThrough;          // Lines Pass 2 knows to be encoded
+	pthread_t lexer;
+	pthread_t encoder;
+	pthread_t writer;
+} pipeline;
+
+// Used by Pass 2 to write an output file through the writer thread with stdio
+// Each file fills its own chunk, since the .obj and listing files are written alternately
+typedef struct outputFile {
+	pipeline* stages;
+	int descriptor;
+	off_t position;
+	off_t size;
+	outputChunk chunk;           // Output not yet handed to the writer thread
+} outputFile;
+
+void awaitEncodedLine(pipeline* stages, int lineIndex);
+void* claimSlot(batchRing* ring);
+void closeRing(batchRing* ring);
+void finishPipeline(pipeline* stages);
+bool nextLexedLine(pipeline* stages, sourceLine* line);
+FILE* openOutputFile(char* filename, char* mode, pipeline* stages);
+void publishSlot(batchRing* ring);
+pipeline* startPipeline(char* filename, struct assembly* state);
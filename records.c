@@ -0,0 +1,156 @@
+#include "assembler.h"
+#include <sys/stat.h>
+
+void appendPackedByte(recordPacker* packer, unsigned char value);
+bool isChangedByte(memoryImage* current, memoryImage* previous, int address);
+int writeDeltaRecords(recordPacker* packer, memoryImage* current, memoryImage* previous);
+void writePackedRecord(recordPacker* packer);
+
+// Adds a byte to the current Text record, writing the record first if it is full
+void appendPackedByte(recordPacker* packer, unsigned char value)
+{
+	if (packer->count == packer->limit)
+	{
+		writePackedRecord(packer);
+	}
+	packer->bytes[packer->count++] = value;
+}
+
+// Writes the last Text record, if it holds any bytes
+void finishPackedRecords(recordPacker* packer)
+{
+	if (packer->count > 0)
+	{
+		writePackedRecord(packer);
+	}
+}
+
+// Returns true if the byte at the address is object code of the current image that the previous
+// image does not hold; otherwise, false
+bool isChangedByte(memoryImage* current, memoryImage* previous, int address)
+{
+	return current->loaded[address] && (!previous->loaded[address] || previous->bytes[address] != current->bytes[address]);
+}
+
+// Prepares the packer to write Text records of up to the provided number of bytes to the file
+void initializeRecordPacker(recordPacker* packer, FILE* file, int limit)
+{
+	memset(packer, 0, sizeof(recordPacker));
+	packer->file = file;
+	packer->limit = limit;
+}
+
+// Packs the object code of one line, most significant byte first, at the provided address
+// A gap since the previous line is filled with zero bytes when that is shorter than starting a new record
+void packBytes(recordPacker* packer, int address, int value, int count)
+{
+	int gap = address - packer->nextAddress;
+
+	if (packer->count > 0 && gap != 0)
+	{
+		if (gap > 0 && gap * 2 < TEXT_RECORD_FRAMING)
+		{
+			for (int x = 0; x < gap; x++)
+			{
+				appendPackedByte(packer, 0);
+			}
+			packer->fillCount += gap;
+		}
+		else
+		{
+			writePackedRecord(packer);
+		}
+	}
+	if (packer->count == 0)
+	{
+		packer->recordAddress = address;
+	}
+
+	for (int x = count - 1; x >= 0; x--)
+	{
+		appendPackedByte(packer, (value >> (x * 8)) & 0xFF);
+	}
+	packer->nextAddress = address + count;
+}
+
+// Compares a newly written .obj file with the previous .obj file or memory image and writes a delta
+// object holding only what a loader that still holds the previous image needs to load
+void writeDeltaObject(char* objectName, char* previousName, char* deltaName, int limit)
+{
+	memoryImage current, previous;
+	recordPacker packer;
+	struct stat object;
+	FILE* file;
+	int changed;
+
+	loadObjectFile(objectName, &current);
+	loadMemoryImage(previousName, &previous);
+	if (!(file = fopen(deltaName, "w")))
+	{
+		displayError(FILE_NOT_FOUND, deltaName);
+		exit(-1);
+	}
+
+	initializeRecordPacker(&packer, file, limit);
+	changed = writeDeltaRecords(&packer, &current, &previous);
+	stat(objectName, &object);
+	printf("Delta object has %d Text records for %d changed bytes; %ld bytes instead of %ld.\n",
+		packer.recordCount, changed, ftell(file), (long)object.st_size);
+
+	fclose(file);
+	freeMemoryImage(&current);
+	freeMemoryImage(&previous);
+}
+
+// Writes the Header and End records of the current image with Text records of only the bytes that
+// differ from the previous image
+// Unchanged object code between two changes is sent again when that is shorter than starting a new
+// record; reserved areas are never written, so data a running program keeps there is left alone
+// Returns the number of changed bytes
+int writeDeltaRecords(recordPacker* packer, memoryImage* current, memoryImage* previous)
+{
+	int address = current->start, changed = 0;
+
+	fprintf(packer->file, "H%-6s%06X%06X\n", current->name, current->start, current->end - current->start);
+	while (address < current->end)
+	{
+		if (!isChangedByte(current, previous, address))
+		{
+			address++;
+			continue;
+		}
+
+		int last = address;
+		for (int x = address + 1; x < current->end && current->loaded[x] && (x - last) * 2 < TEXT_RECORD_FRAMING; x++)
+		{
+			if (isChangedByte(current, previous, x))
+			{
+				last = x;
+			}
+		}
+
+		for (; address <= last; address++)
+		{
+			changed += isChangedByte(current, previous, address);
+			packBytes(packer, address, current->bytes[address], 1);
+		}
+		finishPackedRecords(packer);
+	}
+	fprintf(packer->file, "E%06X", current->entry);
+	return changed;
+}
+
+// Writes the bytes of the current Text record and starts the next record where it ends
+void writePackedRecord(recordPacker* packer)
+{
+	fprintf(packer->file, "T%06X%02X", packer->recordAddress, packer->count);
+	for (int x = 0; x < packer->count; x++)
+	{
+		fprintf(packer->file, "%02X", packer->bytes[x]);
+	}
+	fprintf(packer->file, "\n");
+
+	packer->recordAddress += packer->count;
+	packer->count = 0;
+	packer->recordCount++;
+}
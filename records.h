@@ -0,0 +1,22 @@
+#pragma once
+
+#define MAX_PACKED_RECORD_SIZE 255
+#define TEXT_RECORD_FRAMING 10   // Characters of a Text record besides its data: 'T', address, length and newline
+
+// Used to pack object code into Text records of up to a chosen length
+// Instructions may continue in the next record, and short reserved gaps are filled with zero bytes
+typedef struct recordPacker {
+	FILE* file;
+	int limit;                   // Maximum bytes in a Text record
+	int recordAddress;
+	int nextAddress;             // Address following the last packed byte
+	unsigned char bytes[MAX_PACKED_RECORD_SIZE];
+	int count;
+	int recordCount;
+	int fillCount;               // Zero bytes written into reserved gaps
+} recordPacker;
+
+void finishPackedRecords(recordPacker* packer);
+void initializeRecordPacker(recordPacker* packer, FILE* file, int limit);
+void packBytes(recordPacker* packer, int address, int value, int count);
+void writeDeltaObject(char* objectName, char* previousName, char* deltaName, int limit);
@@ -0,0 +1,810 @@
+#include "assembler.h"
+#include <limits.h>
+#include <sys/stat.h>
+
+#define OPERAND_COLUMN ((SEGMENT_SIZE - 1) * 2)
+#define OPERATION_COLUMN (SEGMENT_SIZE - 1)
+#define SPACE 32
+
+void applyCondition(sourceReader* reader, sourceLine* line, int directiveType, char* operand);
+bool evaluateCondition(sourceReader* reader, char* operand);
+int getConditionType(char* statement, size_t length);
+void getOperandText(char* statement, char* operand);
+void includeFile(sourceReader* reader, sourceLine* line, char* name);
+void invokeMacro(sourceReader* reader, int macroIndex, sourceLine* line, char* arguments);
+void lexIncludedFile(includedFile* file, char* path);
+void lexLine(char* statement, sourceLine* line);
+bool lexStatement(char* statement, sourceLine* line, char* operand);
+void markDefinedLabel(sourceReader* reader, int labelId);
+FILE* prepareSourceReader(sourceReader* reader, char* filename, bool openFile);
+bool readLexedLine(sourceReader* reader, sourceLine* line, char* operand);
+bool readRawLine(sourceReader* reader, char* statement);
+void readMacroDefinition(sourceReader* reader, sourceLine* line, char* parameters);
+void refillSourceWindow(sourceReader* reader);
+int skipInactiveLines(sourceReader* reader);
+int skipToCondition(sourceReader* reader);
+
+// Included files are cached for the whole run, so batch jobs and watch mode rebuilds share them
+includedFile* includedFiles = NULL;
+
+// Counts the assemblies of the run, so each included file can record the last one that included it
+int assemblyCount = 0;
+
+// Adds a lexed line to the end of the line stream
+// Returns the stored copy of the line
+sourceLine* appendLine(lineStream* stream, sourceLine* line)
+{
+	if (stream->count == stream->capacity)
+	{
+		stream->capacity = stream->capacity ? stream->capacity * 2 : 64;
+		stream->lines = (sourceLine*)realloc(stream->lines, sizeof(sourceLine) * stream->capacity);
+	}
+	stream->lines[stream->count] = *line;
+	return &stream->lines[stream->count++];
+}
+
+// Handles an IF, ELSE or ENDIF read from an active part of the source
+// An IF whose condition is false and the ELSE of a block that was active are followed by an inactive part,
+// which is skipped up to the ELSE or ENDIF that ends it
+void applyCondition(sourceReader* reader, sourceLine* line, int directiveType, char* operand)
+{
+	conditionContext* condition = reader->conditionDepth ? &reader->conditions[reader->conditionDepth - 1] : NULL;
+
+	if (line->segments.label[0] != '\0')
+	{
+		displayError(ILLEGAL_CONDITION, line->segments.label);
+		exit(-1);
+	}
+
+	if (isIfDirective(directiveType))
+	{
+		if (reader->conditionDepth == MAX_CONDITION_DEPTH)
+		{
+			displayError(ILLEGAL_CONDITION, line->segments.operation);
+			exit(-1);
+		}
+		condition = &reader->conditions[reader->conditionDepth];
+		condition->includeDepth = reader->includeDepth;
+		condition->elseSeen = false;
+		if (evaluateCondition(reader, operand))
+		{
+			reader->conditionDepth++;
+		}
+		else if (isElseDirective(skipInactiveLines(reader)))
+		{
+			condition->elseSeen = true;
+			reader->conditionDepth++;
+		}
+		return;
+	}
+
+	// ELSE and ENDIF close the innermost block, which must have been opened in the same file
+	if (reader->conditionDepth == 0 || condition->includeDepth != reader->includeDepth ||
+		(isElseDirective(directiveType) && condition->elseSeen))
+	{
+		displayError(ILLEGAL_CONDITION, line->segments.operation);
+		exit(-1);
+	}
+	if (isElseDirective(directiveType) && !isEndifDirective(skipInactiveLines(reader)))
+	{
+		displayError(ILLEGAL_CONDITION, line->segments.operation);
+		exit(-1);
+	}
+	reader->conditionDepth--;
+}
+
+// Starts a new assembly for the record of which files it includes
+// Returns the ID the files it includes are marked with
+int beginIncludeRecord(void)
+{
+	return ++assemblyCount;
+}
+
+// Releases the source file and the macro table held by the reader
+void closeSourceReader(sourceReader* reader)
+{
+	if (reader->stream != NULL)
+	{
+		fclose(reader->stream);
+		reader->stream = NULL;
+	}
+	free(reader->buffer);
+	free(reader->definedLabels);
+	freeMacroTable(&reader->macros);
+	reader->buffer = NULL;
+	reader->definedLabels = NULL;
+	reader->includeDepth = 0;
+}
+
+// Evaluates the condition of an IF: a decimal constant is true when it is not 0, and a symbol is true when
+// it labels an earlier line of the line stream
+// Returns the value of the condition
+bool evaluateCondition(sourceReader* reader, char* operand)
+{
+	char condition[INPUT_BUF_SIZE];
+	int labelId;
+
+	strcpy(condition, operand);
+	trim(condition);
+	if (condition[0] == '\0')
+	{
+		displayError(ILLEGAL_CONDITION, "IF");
+		exit(-1);
+	}
+	if (isNumeric(condition))
+	{
+		return strtol(condition, NULL, 10) != 0;
+	}
+	labelId = findName(condition);
+	return labelId != NO_NAME && labelId < reader->definedCapacity && reader->definedLabels[labelId];
+}
+
+// Releases the lines held by the line stream
+void freeLineStream(lineStream* stream)
+{
+	free(stream->lines);
+	stream->lines = NULL;
+	stream->count = stream->capacity = 0;
+}
+
+// Finds the directive in the operation column of a raw line when it is an IF, ELSE or ENDIF, without
+// lexing the line; comment lines and lines too short to reach the operation column have none
+// Returns the directive type; otherwise, 0
+int getConditionType(char* statement, size_t length)
+{
+	char operation[SEGMENT_SIZE];
+	size_t column = OPERATION_COLUMN;
+	int count = 0;
+
+	if (length <= OPERATION_COLUMN || statement[0] == COMMENT)
+	{
+		return 0;
+	}
+	while (column < length && column < OPERAND_COLUMN && statement[column] == SPACE)
+	{
+		column++;
+	}
+	if (column == length || (statement[column] != 'I' && statement[column] != 'E'))
+	{
+		return 0;
+	}
+	while (column < length && column < OPERAND_COLUMN && statement[column] > SPACE)
+	{
+		operation[count++] = statement[column++];
+	}
+	operation[count] = '\0';
+
+	int directiveType = isDirective(operation);
+	return isIfDirective(directiveType) || isElseDirective(directiveType) || isEndifDirective(directiveType) ? directiveType : 0;
+}
+
+// Returns the files included so far in this run
+includedFile* getIncludedFiles(void)
+{
+	return includedFiles;
+}
+
+// Returns the ID the files included by the current assembly are marked with
+int getIncludeRecord(void)
+{
+	return assemblyCount;
+}
+
+// Copies the untruncated operand text of a statement, which may be longer than a segment
+// MACRO parameter lists and macro arguments use the rest of the line after the Operation segment
+void getOperandText(char* statement, char* operand)
+{
+	int length = 0;
+
+	if (strlen(statement) > OPERAND_COLUMN)
+	{
+		strcpy(operand, statement + OPERAND_COLUMN);
+		length = strlen(operand);
+	}
+	while (length > 0 && isspace((unsigned char)operand[length - 1]))
+	{
+		length--;
+	}
+	operand[length] = '\0';
+}
+
+// Splices the lines of an included file into the line stream
+// The file is found relative to the file that includes it and is lexed again only when it has changed
+void includeFile(sourceReader* reader, sourceLine* line, char* name)
+{
+	char path[PATH_MAX];
+	char realPath[PATH_MAX];
+	char* including = getName(line->fileId);
+	char* slash = strrchr(including, '/');
+	struct stat status;
+	includedFile* file;
+	int pathId;
+
+	if (name[0] == '\0' || line->segments.label[0] != '\0')
+	{
+		displayError(ILLEGAL_INCLUDE, line->segments.label[0] != '\0' ? line->segments.label : line->segments.operation);
+		exit(-1);
+	}
+
+	if (name[0] == '/' || slash == NULL)
+	{
+		snprintf(path, PATH_MAX, "%s", name);
+	}
+	else
+	{
+		snprintf(path, PATH_MAX, "%.*s/%s", (int)(slash - including), including, name);
+	}
+	if (realpath(path, realPath) == NULL || stat(realPath, &status) != 0)
+	{
+		displayError(FILE_NOT_FOUND, path);
+		exit(-1);
+	}
+
+	// A file that is still being read would include itself again without end
+	pathId = internName(realPath);
+	if (pathId == reader->pathId || reader->includeDepth == MAX_INCLUDE_DEPTH)
+	{
+		displayError(ILLEGAL_INCLUDE, path);
+		exit(-1);
+	}
+	for (int x = 0; x < reader->includeDepth; x++)
+	{
+		if (reader->includes[x].file->pathId == pathId)
+		{
+			displayError(ILLEGAL_INCLUDE, path);
+			exit(-1);
+		}
+	}
+
+	for (file = includedFiles; file != NULL && file->pathId != pathId; file = file->next);
+	if (file == NULL)
+	{
+		file = (includedFile*)calloc(1, sizeof(includedFile));
+		file->pathId = pathId;
+		file->nameId = internName(path);
+		file->next = includedFiles;
+		includedFiles = file;
+	}
+	if (file->lines == NULL || file->size != status.st_size || file->modified.tv_sec != status.st_mtim.tv_sec ||
+			file->modified.tv_nsec != status.st_mtim.tv_nsec)
+	{
+		lexIncludedFile(file, path);
+		file->modified = status.st_mtim;
+		file->size = status.st_size;
+	}
+
+	file->assemblyId = assemblyCount;
+
+	reader->includes[reader->includeDepth].file = file;
+	reader->includes[reader->includeDepth++].index = 0;
+}
+
+// Gives the label, operation and operand symbol of the line their interned IDs
+void internLine(sourceLine* line)
+{
+	segment* segments = &line->segments;
+	char symbolName[SEGMENT_SIZE];
+	int mode = classifyAddressing(segments->operand, FORMAT_3, symbolName);
+
+	line->labelId = segments->label[0] != '\0' ? internName(segments->label) : NO_NAME;
+	line->operationId = segments->operation[0] != '\0' ? internName(segments->operation) : NO_NAME;
+
+	// Numbers and BYTE constants are not symbols
+	if (isConstantMode(mode) || symbolName[0] == '\0' || isNumeric(symbolName) || strchr(symbolName, '\'') != NULL)
+	{
+		line->symbolId = NO_NAME;
+	}
+	else
+	{
+		line->symbolId = internName(symbolName);
+	}
+}
+
+// Splices the cached expansion of a macro invocation into the line stream
+void invokeMacro(sourceReader* reader, int macroIndex, sourceLine* line, char* arguments)
+{
+	macroExpansion* expansion = expandMacro(&reader->macros, macroIndex, arguments);
+	sourceContext* context;
+
+	if (reader->depth == MAX_SOURCE_DEPTH)
+	{
+		displayError(ILLEGAL_MACRO, line->segments.operation);
+		exit(-1);
+	}
+	if (line->segments.label[0] != '\0' &&
+			(expansion->lineCount == 0 || expansion->lines[0].label[0] != '\0'))
+	{
+		displayError(ILLEGAL_MACRO, line->segments.label);
+		exit(-1);
+	}
+
+	context = &reader->contexts[reader->depth++];
+	context->expansion = expansion;
+	context->expansionId = reader->macros.definitions[macroIndex].hasLocalLabels ? reader->macros.expansionCount++ : -1;
+	context->index = 0;
+	context->lineNumber = line->lineNumber;
+	context->fileId = line->fileId;
+	strcpy(context->label, line->segments.label);
+}
+
+// Lexes every line of an included file into its cache entry
+void lexIncludedFile(includedFile* file, char* path)
+{
+	char statement[INPUT_BUF_SIZE];
+	char operand[INPUT_BUF_SIZE];
+	sourceReader reader;
+	sourceLine line;
+	int capacity = 0;
+
+	openSourceReader(&reader, path);
+	free(file->lines);
+	file->lines = NULL;
+	file->lineCount = 0;
+
+	while (readRawLine(&reader, statement))
+	{
+		setErrorLocation(getName(file->nameId), reader.lineNumber);
+		if (!lexStatement(statement, &line, operand))
+		{
+			continue;
+		}
+
+		if (file->lineCount == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 64;
+			file->lines = (includedLine*)realloc(file->lines, sizeof(includedLine) * capacity);
+		}
+		file->lines[file->lineCount].segments = line.segments;
+		file->lines[file->lineCount].lineNumber = reader.lineNumber;
+		strcpy(file->lines[file->lineCount++].operand, operand);
+	}
+	closeSourceReader(&reader);
+}
+
+// Separates a statement into its segments and stores them in the provided line
+void lexLine(char* statement, sourceLine* line)
+{
+	segment* segments = prepareSegments(statement);
+	line->segments = *segments;
+	free(segments);
+}
+
+// Lexes a statement of a source file into the provided line and its untruncated operand text
+// Returns false if the statement is a comment; otherwise, true
+bool lexStatement(char* statement, sourceLine* line, char* operand)
+{
+	if (statement[0] < 32)
+	{
+		displayError(BLANK_RECORD, NULL);
+		exit(-1);
+	}
+	else if (statement[0] == COMMENT)
+	{
+		return false;
+	}
+
+	memset(line, 0, sizeof(sourceLine));
+	lexLine(statement, line);
+	getOperandText(statement, operand);
+	return true;
+}
+
+// Records that the label is defined, so later IF conditions that name it are true
+void markDefinedLabel(sourceReader* reader, int labelId)
+{
+	if (labelId >= reader->definedCapacity)
+	{
+		int capacity = reader->definedCapacity ? reader->definedCapacity : 64;
+		while (labelId >= capacity)
+		{
+			capacity *= 2;
+		}
+		reader->definedLabels = (bool*)realloc(reader->definedLabels, sizeof(bool) * capacity);
+		memset(reader->definedLabels + reader->definedCapacity, 0, sizeof(bool) * (capacity - reader->definedCapacity));
+		reader->definedCapacity = capacity;
+	}
+	reader->definedLabels[labelId] = true;
+}
+
+// Returns the next line of the line stream, with comments removed and macros and included files expanded
+// Returns false once the end of the source file is reached
+bool nextSourceLine(sourceReader* reader, sourceLine* line)
+{
+	char operand[INPUT_BUF_SIZE];
+	int macroIndex;
+
+	while (true)
+	{
+		memset(line, 0, sizeof(sourceLine));
+		if (reader->depth > 0)
+		{
+			sourceContext* context = &reader->contexts[reader->depth - 1];
+			if (context->index == context->expansion->lineCount)
+			{
+				reader->depth--;
+				continue;
+			}
+
+			line->segments = context->expansion->lines[context->index];
+			line->lineNumber = context->lineNumber;
+			line->fileId = context->fileId;
+			if (context->index++ == 0 && context->label[0] != '\0')
+			{
+				strcpy(line->segments.label, context->label);
+			}
+			if (context->expansionId >= 0)
+			{
+				renameLocalLabels(&line->segments, context->expansionId);
+			}
+			// Nested invocations use the already substituted operand as their arguments
+			strcpy(operand, line->segments.operand);
+		}
+		else if (!readLexedLine(reader, line, operand))
+		{
+			// The source file ended inside an IF block
+			if (reader->conditionDepth > 0)
+			{
+				displayError(ILLEGAL_CONDITION, "ENDIF");
+				exit(-1);
+			}
+			return false;
+		}
+		setErrorLocation(getName(line->fileId), line->lineNumber);
+
+		int directiveType = isDirective(line->segments.operation);
+		if (isMacroDirective(directiveType) && reader->depth == 0)
+		{
+			readMacroDefinition(reader, line, operand);
+			continue;
+		}
+		else if (isMacroDirective(directiveType) || isMendDirective(directiveType))
+		{
+			displayError(ILLEGAL_MACRO, line->segments.operation);
+			exit(-1);
+		}
+		else if (isIncludeDirective(directiveType))
+		{
+			// Macro bodies are not lexed again, so an expansion cannot include a file
+			if (reader->depth > 0)
+			{
+				displayError(ILLEGAL_MACRO, line->segments.operation);
+				exit(-1);
+			}
+			includeFile(reader, line, operand);
+			continue;
+		}
+		else if (isIfDirective(directiveType) || isElseDirective(directiveType) || isEndifDirective(directiveType))
+		{
+			// Expansions are not lexed again either, so a macro body cannot hold a condition
+			if (reader->depth > 0)
+			{
+				displayError(ILLEGAL_MACRO, line->segments.operation);
+				exit(-1);
+			}
+			applyCondition(reader, line, directiveType, operand);
+			continue;
+		}
+
+		if ((macroIndex = findMacro(&reader->macros, line->segments.operation)) >= 0)
+		{
+			invokeMacro(reader, macroIndex, line, operand);
+			continue;
+		}
+		internLine(line);
+		if (line->labelId != NO_NAME)
+		{
+			markDefinedLabel(reader, line->labelId);
+		}
+		return true;
+	}
+}
+
+// Reads the entire source file into memory so its lines can be streamed
+// A source file read ahead by asynchronous I/O is taken from memory instead
+void openSourceReader(sourceReader* reader, char* filename)
+{
+	size_t prefetchedSize;
+	char* prefetched = claimPrefetchedFile(filename, &prefetchedSize);
+	FILE* file = prepareSourceReader(reader, filename, prefetched == NULL);
+	long size;
+
+	if (prefetched != NULL)
+	{
+		reader->buffer = prefetched;
+		reader->size = prefetchedSize;
+		return;
+	}
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+
+	reader->buffer = (char*)malloc(size + 1);
+	reader->size = fread(reader->buffer, 1, size, file);
+	reader->buffer[reader->size] = '\0';
+	fclose(file);
+}
+
+// Opens the source file so it is read SOURCE_WINDOW_SIZE bytes at a time instead of all at once
+void openSourceStream(sourceReader* reader, char* filename)
+{
+	reader->stream = prepareSourceReader(reader, filename, true);
+	reader->buffer = (char*)malloc(SOURCE_WINDOW_SIZE);
+}
+
+// Do no modify any part of this function
+// Separates a SIC/XE instruction into individual sections
+segment* prepareSegments(char* statement)
+{
+	segment* temp = calloc(1, sizeof(segment));
+	strncpy(temp->label, statement, SEGMENT_SIZE - 1);
+	strncpy(temp->operation, statement + SEGMENT_SIZE - 1, SEGMENT_SIZE - 1);
+	strncpy(temp->operand, statement + (SEGMENT_SIZE - 1) * 2, SEGMENT_SIZE - 1);
+	trim(temp->label);
+	trim(temp->operation);
+	trim(temp->operand);
+	return temp;
+}
+
+// Prepares an empty reader for the source file, opening it when openFile is set
+// Returns the opened source file; otherwise, NULL
+FILE* prepareSourceReader(sourceReader* reader, char* filename, bool openFile)
+{
+	FILE* file = openFile ? fopen(filename, "rb") : NULL;
+	char path[PATH_MAX];
+
+	if (openFile && !file)
+	{
+		displayError(FILE_NOT_FOUND, filename);
+		exit(-1);
+	}
+
+	memset(reader, 0, sizeof(sourceReader));
+	reader->filename = filename;
+	reader->fileId = internName(filename);
+	reader->pathId = realpath(filename, path) ? internName(path) : NO_NAME;
+	initializeMacroTable(&reader->macros);
+	return file;
+}
+
+// Returns the next lexed line of the innermost included file, or of the source file once the
+// included files are exhausted
+// Returns false once the end of the source file is reached
+bool readLexedLine(sourceReader* reader, sourceLine* line, char* operand)
+{
+	char statement[INPUT_BUF_SIZE];
+
+	while (reader->includeDepth > 0)
+	{
+		includeContext* include = &reader->includes[reader->includeDepth - 1];
+		if (include->index == include->file->lineCount)
+		{
+			// An IF block cannot continue past the end of the included file it was opened in
+			if (reader->conditionDepth > 0 && reader->conditions[reader->conditionDepth - 1].includeDepth == reader->includeDepth)
+			{
+				setErrorLocation(getName(include->file->nameId), include->file->lines[include->index - 1].lineNumber);
+				displayError(ILLEGAL_CONDITION, "ENDIF");
+				exit(-1);
+			}
+			reader->includeDepth--;
+			continue;
+		}
+
+		includedLine* stored = &include->file->lines[include->index++];
+		memset(line, 0, sizeof(sourceLine));
+		line->segments = stored->segments;
+		line->lineNumber = stored->lineNumber;
+		line->fileId = include->file->nameId;
+		strcpy(operand, stored->operand);
+		return true;
+	}
+
+	while (readRawLine(reader, statement))
+	{
+		setErrorLocation(reader->filename, reader->lineNumber);
+		if (lexStatement(statement, line, operand))
+		{
+			line->lineNumber = reader->lineNumber;
+			line->fileId = reader->fileId;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Collects the body of a MACRO definition up to its MEND into the definition table
+void readMacroDefinition(sourceReader* reader, sourceLine* line, char* parameters)
+{
+	char operand[INPUT_BUF_SIZE];
+	sourceLine bodyLine;
+	int macroIndex = defineMacro(&reader->macros, line->segments.label, parameters);
+
+	while (readLexedLine(reader, &bodyLine, operand))
+	{
+		setErrorLocation(getName(bodyLine.fileId), bodyLine.lineNumber);
+		int directiveType = isDirective(bodyLine.segments.operation);
+		if (isMendDirective(directiveType))
+		{
+			return;
+		}
+		else if (isMacroDirective(directiveType))
+		{
+			displayError(ILLEGAL_MACRO, bodyLine.segments.label);
+			exit(-1);
+		}
+		addMacroLine(&reader->macros, macroIndex, &bodyLine.segments);
+	}
+
+	// The source file ended before the definition was closed by MEND
+	displayError(ILLEGAL_MACRO, line->segments.label);
+	exit(-1);
+}
+
+// Copies the next line of the source file without its line terminator
+// The copy is padded with '\0' so every segment of a short line is empty
+// Returns false once the end of the source file is reached
+bool readRawLine(sourceReader* reader, char* statement)
+{
+	char* start;
+	char* end;
+	size_t length;
+
+	// A streamed source file is read again once the window no longer holds a whole line
+	if (reader->stream != NULL && memchr(reader->buffer + reader->position, '\n', reader->size - reader->position) == NULL)
+	{
+		refillSourceWindow(reader);
+	}
+	start = reader->buffer + reader->position;
+
+	if (reader->position >= reader->size)
+	{
+		return false;
+	}
+
+	end = memchr(start, '\n', reader->size - reader->position);
+	length = end ? (size_t)(end - start) : reader->size - reader->position;
+	reader->position += length + (end ? 1 : 0);
+	reader->lineNumber++;
+
+	if (length > 0 && start[length - 1] == '\r')
+	{
+		length--;
+	}
+	if (length > INPUT_BUF_SIZE - 1)
+	{
+		length = INPUT_BUF_SIZE - 1;
+	}
+	memset(statement, '\0', INPUT_BUF_SIZE);
+	memcpy(statement, start, length);
+	return true;
+}
+
+// Moves the unread text of a streamed source file to the front of the window and fills the rest of it
+void refillSourceWindow(sourceReader* reader)
+{
+	size_t count;
+
+	memmove(reader->buffer, reader->buffer + reader->position, reader->size - reader->position);
+	reader->size -= reader->position;
+	reader->position = 0;
+
+	count = fread(reader->buffer + reader->size, 1, SOURCE_WINDOW_SIZE - reader->size, reader->stream);
+	reader->size += count;
+	if (count == 0)
+	{
+		fclose(reader->stream);
+		reader->stream = NULL;
+	}
+}
+
+// Reads every line of the source file into the line stream without assembling it
+void readLineStream(char* filename, lineStream* lines)
+{
+	sourceReader reader;
+	sourceLine line;
+
+	openSourceReader(&reader, filename);
+	while (nextSourceLine(&reader, &line))
+	{
+		appendLine(lines, &line);
+	}
+	closeSourceReader(&reader);
+	setErrorLocation(NULL, 0);
+}
+
+// Skips the inactive part of an IF block, including the IF blocks nested in it
+// Returns the ELSE or ENDIF directive type that ends the part
+int skipInactiveLines(sourceReader* reader)
+{
+	int nesting = 0;
+	int directiveType;
+
+	while ((directiveType = skipToCondition(reader)) != 0)
+	{
+		if (isIfDirective(directiveType))
+		{
+			nesting++;
+		}
+		else if (nesting == 0)
+		{
+			return directiveType;
+		}
+		else if (isEndifDirective(directiveType))
+		{
+			nesting--;
+		}
+	}
+
+	// The file ended inside the inactive part
+	displayError(ILLEGAL_CONDITION, "ENDIF");
+	exit(-1);
+}
+
+// Moves past the lines of the file being read up to and including its next IF, ELSE or ENDIF
+// The lines of the source file are not lexed: each costs a memchr for its end and a look at its operation
+// column. Lines of an included file were lexed when it was first included, so only their operation is compared
+// Returns the directive type; otherwise, 0 (the end of the file was reached)
+int skipToCondition(sourceReader* reader)
+{
+	int directiveType;
+
+	if (reader->includeDepth > 0)
+	{
+		includeContext* include = &reader->includes[reader->includeDepth - 1];
+		while (include->index < include->file->lineCount)
+		{
+			includedLine* stored = &include->file->lines[include->index++];
+			char first = stored->segments.operation[0];
+
+			if ((first == 'I' || first == 'E') && (directiveType = isDirective(stored->segments.operation)) != 0 &&
+				(isIfDirective(directiveType) || isElseDirective(directiveType) || isEndifDirective(directiveType)))
+			{
+				setErrorLocation(getName(include->file->nameId), stored->lineNumber);
+				return directiveType;
+			}
+		}
+		return 0;
+	}
+
+	while (true)
+	{
+		char* start;
+		char* end;
+		size_t length;
+
+		// A streamed source file is read again once the window no longer holds a whole line
+		if (reader->stream != NULL && memchr(reader->buffer + reader->position, '\n', reader->size - reader->position) == NULL)
+		{
+			refillSourceWindow(reader);
+		}
+		if (reader->position >= reader->size)
+		{
+			return 0;
+		}
+
+		start = reader->buffer + reader->position;
+		end = memchr(start, '\n', reader->size - reader->position);
+		length = end ? (size_t)(end - start) : reader->size - reader->position;
+		reader->position += length + (end ? 1 : 0);
+		reader->lineNumber++;
+
+		if ((directiveType = getConditionType(start, length)) != 0)
+		{
+			setErrorLocation(reader->filename, reader->lineNumber);
+			return directiveType;
+		}
+	}
+}
+
+// Do no modify any part of this function
+// Removes spaces from the end of a segment value
+void trim(char value[])
+{
+	for (int x = 0; x < SEGMENT_SIZE; x++)
+	{
+		if (value[x] == SPACE)
+		{
+			value[x] = '\0';
+		}
+	}
+}
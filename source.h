@@ -0,0 +1,110 @@
+#pragma once
+
+#define MAX_CONDITION_DEPTH 16
+#define MAX_INCLUDE_DEPTH 16
+#define MAX_SOURCE_DEPTH 16
+#define SOURCE_WINDOW_SIZE 65536
+
+// Used to store a single lexed line of the assembler's line stream
+typedef struct sourceLine {
+	segment segments;
+	int lineNumber;
+	int fileId;                  // Interned name of the file the line was read from
+	int address;                 // Location counter assigned by Pass 1
+	bool relaxed;                // '+' was added to or dropped from the operation by --optimize
+	int labelId;                 // Interned IDs, NO_NAME when the segment is empty
+	int operationId;
+	int symbolId;                // Operand symbol without '#', '@' or ",X"; NO_NAME for constants
+} sourceLine;
+
+// Used to store the lexed lines handed from Pass 1 to Pass 2
+typedef struct lineStream {
+	sourceLine* lines;
+	int count;
+	int capacity;
+} lineStream;
+
+// Used to track a macro expansion that is being spliced into the line stream
+typedef struct sourceContext {
+	macroExpansion* expansion;
+	int expansionId;             // -1 when the macro has no local labels
+	int index;                   // Next line of the expansion to produce
+	int lineNumber;              // Line number of the macro invocation
+	int fileId;                  // File of the macro invocation
+	char label[SEGMENT_SIZE];    // Invocation label, given to the first expanded line
+} sourceContext;
+
+// Used to store a line of an included file once it has been lexed
+typedef struct includedLine {
+	segment segments;
+	int lineNumber;
+	char operand[INPUT_BUF_SIZE]; // Untruncated operand text, used by MACRO and macro invocations
+} includedLine;
+
+// Used to cache the lexed lines of an included file for the rest of the run
+// Every INCLUDE of the file shares the lines; they are lexed again only when the file changes
+typedef struct includedFile {
+	int pathId;                  // Interned real path, which identifies the file
+	int nameId;                  // Interned path the file was first included by, used in messages
+	includedLine* lines;
+	int lineCount;
+	struct timespec modified;    // Modification time and size when the file was lexed
+	off_t size;
+	int assemblyId;              // Last assembly that included the file
+	struct includedFile* next;
+} includedFile;
+
+// Used to track an included file whose lines are being spliced into the line stream
+typedef struct includeContext {
+	includedFile* file;
+	int index;                   // Next line of the file to produce
+} includeContext;
+
+// Used to track an IF block whose active lines are being read
+typedef struct conditionContext {
+	int includeDepth;            // Included file the IF was read from; 0 for the source file
+	bool elseSeen;               // The ELSE of the block has been read
+} conditionContext;
+
+// Used to produce the assembler's line stream from a source file
+typedef struct sourceReader {
+	char* filename;
+	int fileId;                  // Interned name of the source file
+	int pathId;                  // Interned real path of the source file
+	char* buffer;                // Entire source file, or a window of it when the file is streamed
+	FILE* stream;                // Streamed source file; NULL once it has been read to the end
+	size_t size;
+	size_t position;
+	int lineNumber;
+	sourceContext contexts[MAX_SOURCE_DEPTH];
+	int depth;
+	includeContext includes[MAX_INCLUDE_DEPTH];
+	int includeDepth;
+	conditionContext conditions[MAX_CONDITION_DEPTH];
+	int conditionDepth;
+	bool* definedLabels;         // Label IDs on the lines read so far, which IF conditions test
+	int definedCapacity;
+	macroTable macros;
+} sourceReader;
+
+sourceLine* appendLine(lineStream* stream, sourceLine* line);
+int beginIncludeRecord(void);
+void closeSourceReader(sourceReader* reader);
+void freeLineStream(lineStream* stream);
+includedFile* getIncludedFiles(void);
+int getIncludeRecord(void);
+void internLine(sourceLine* line);
+bool nextSourceLine(sourceReader* reader, sourceLine* line);
+void openSourceReader(sourceReader* reader, char* filename);
+void openSourceStream(sourceReader* reader, char* filename);
+void readLineStream(char* filename, lineStream* lines);
+segment* prepareSegments(char* line);
+void trim(char string[]);
+
+// Directive tests of the source reader; defined in directives.c
+bool isElseDirective(int directiveType);
+bool isEndifDirective(int directiveType);
+bool isIfDirective(int directiveType);
+bool isIncludeDirective(int directiveType);
+bool isMacroDirective(int directiveType);
+bool isMendDirective(int directiveType);
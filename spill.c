@@ -0,0 +1,74 @@
+#include "assembler.h"
+
+void flushSpill(spillFile* spill);
+
+// Releases the spill file, which removes it
+void closeSpill(spillFile* spill)
+{
+	fclose(spill->file);
+	spill->file = NULL;
+}
+
+// Writes the buffered records to the spill file
+void flushSpill(spillFile* spill)
+{
+	fwrite(spill->records, SPILL_RECORD_SIZE, spill->count, spill->file);
+	spill->count = 0;
+}
+
+// Creates an empty spill file that is removed once it is closed
+void openSpill(spillFile* spill)
+{
+	memset(spill, 0, sizeof(spillFile));
+	spill->file = tmpfile();
+	if (!spill->file)
+	{
+		displayError(FILE_NOT_FOUND, "temporary spill file");
+		exit(-1);
+	}
+}
+
+// Reads the address of the next line from the spill file
+// Returns false once every record has been read
+bool readSpillRecord(spillFile* spill, int* address)
+{
+	unsigned char* record;
+
+	if (spill->index == spill->count)
+	{
+		spill->count = fread(spill->records, SPILL_RECORD_SIZE, SPILL_BUFFER_SIZE, spill->file);
+		spill->index = 0;
+		if (spill->count == 0)
+		{
+			return false;
+		}
+	}
+
+	record = &spill->records[spill->index++ * SPILL_RECORD_SIZE];
+	*address = record[0] | (record[1] << 8) | (record[2] << 16);
+	return true;
+}
+
+// Writes the remaining records and starts reading the spill file from its first record
+void rewindSpill(spillFile* spill)
+{
+	flushSpill(spill);
+	rewind(spill->file);
+	spill->index = 0;
+}
+
+// Adds the address of the next line to the spill file
+void writeSpillRecord(spillFile* spill, int address)
+{
+	unsigned char* record;
+
+	if (spill->count == SPILL_BUFFER_SIZE)
+	{
+		flushSpill(spill);
+	}
+
+	record = &spill->records[spill->count++ * SPILL_RECORD_SIZE];
+	record[0] = address & 0xFF;
+	record[1] = (address >> 8) & 0xFF;
+	record[2] = (address >> 16) & 0xFF;
+}
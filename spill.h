@@ -0,0 +1,19 @@
+#pragma once
+
+#define SPILL_BUFFER_SIZE 4096   // Records buffered in memory between reads or writes of the spill file
+#define SPILL_RECORD_SIZE 3      // SIC/XE addresses fit in 3 bytes
+
+// Used to keep the address Pass 1 assigns to each line in a temporary file, so a bounded-memory
+// assembly can stream the source again in Pass 2 instead of keeping the line stream in memory
+typedef struct spillFile {
+	FILE* file;
+	unsigned char records[SPILL_BUFFER_SIZE * SPILL_RECORD_SIZE];
+	int count;                   // Records in the buffer
+	int index;                   // Next record of the buffer to read
+} spillFile;
+
+void closeSpill(spillFile* spill);
+void openSpill(spillFile* spill);
+bool readSpillRecord(spillFile* spill, int* address);
+void rewindSpill(spillFile* spill);
+void writeSpillRecord(spillFile* spill, int address);
@@ -7,108 +7,122 @@
  *        DO NOT REMOVE THIS MESSAGE
  **********************************************/
 
-#include "headers.h"
+#include "assembler.h"
 
-#define MOD_SIZE 10
-#define SYMBOL_TABLE_SEGMENTS 10
-#define SYMBOL_TABLE_SIZE 100
+#define SYMBOL_TABLE_INITIAL_SLOTS 256
 
-int computeHash(char* input);
-bool isDirectAddressing(char* string);
+int computeHash(int symbolId, int slotCount);
+void growSymbolTable(symbolTable* symbols);
 
-// Do no modify any part of this function
-// Compute a hash value for the provide symbol name
-int computeHash(char* symbolName)
+// Compute a hash value for the provided interned symbol ID in a table with the provided number of slots
+// IDs are dense, so consecutive symbols fill consecutive entries
+int computeHash(int symbolId, int slotCount)
 {
-	int hash = 0;
+	return symbolId & (slotCount - 1);
+}
+
+// Returns the Symbol Table entry of the specified symbol ID if found; otherwise, NULL
+symbol* findSymbol(symbolTable* symbols, int symbolId)
+{
+	int hashIndex;
 
-	for (int x = 0; x < strlen(symbolName); x++)
+	if (symbolId == NO_NAME || symbols->slotCount == 0)
 	{
-		hash += symbolName[x];
+		return NULL;
 	}
-	return hash % MOD_SIZE * SYMBOL_TABLE_SEGMENTS;
+	hashIndex = computeHash(symbolId, symbols->slotCount);
+	while (symbols->slots[hashIndex] != NULL)
+	{
+		if (symbols->slots[hashIndex]->id == symbolId)
+		{
+			return symbols->slots[hashIndex];
+		}
+		hashIndex = (hashIndex + 1) & (symbols->slotCount - 1);
+	}
+	return NULL;
 }
 
-// Do no modify any part of this function
-// Print the contents of the Symbol Table to the screen
-void displaySymbolTable(symbol* symbolTable[])
+// Releases every symbol and the slots of the Symbol Table, leaving it empty
+void freeSymbolTable(symbolTable* symbols)
 {
-	printf("\n%-5s  %-6s  %-7s\n", "Index", " Name ", "Address");
-	printf("%-5s  %-6s  %-7s\n", "-----", "------", "-------");
-	for (int x = 0; x < SYMBOL_TABLE_SIZE; x++)
+	for (int x = 0; x < symbols->slotCount; x++)
 	{
-		if (symbolTable[x] == NULL)
-			continue;
-		printf("%5d  %-6s  0x%X\n", x, symbolTable[x]->name, symbolTable[x]->address);
+		free(symbols->slots[x]);
 	}
+	free(symbols->slots);
+	initializeSymbolTable(symbols);
 }
 
-// Do no modify any part of this function
-// Returns the address of the specified string if found; otherwise, -1
-int getSymbolAddress(struct symbol* symbolArray[], char* string)
+// Returns the address of the specified symbol ID if found
+// The operand is resolved when it is lexed, so it no longer carries its '#' or '@'
+int getSymbolAddress(symbolTable* symbols, int symbolId)
 {
-	int hashIndex;
+	symbol* entry = findSymbol(symbols, symbolId);
 
-	if(!isDirectAddressing(string))
+	if (entry == NULL)
 	{
-		memmove(string, &(string[1]), strlen(&(string[1])) + 1);
+		displayError(UNKNOWN_SYMBOL, getName(symbolId));
+		exit(-1);
 	}
-	hashIndex = computeHash(string);
+	return entry->address;
+}
 
-	while (symbolArray[hashIndex] != NULL && hashIndex < SYMBOL_TABLE_SIZE)
+// Doubles the slots of the Symbol Table and places every symbol again
+void growSymbolTable(symbolTable* symbols)
+{
+	symbol** previous = symbols->slots;
+	int previousCount = symbols->slotCount;
+
+	symbols->slotCount = previousCount ? previousCount * 2 : SYMBOL_TABLE_INITIAL_SLOTS;
+	symbols->slots = (symbol**)calloc(symbols->slotCount, sizeof(symbol*));
+	for (int x = 0; x < previousCount; x++)
 	{
-		if (strcmp(symbolArray[hashIndex]->name, string) == 0)
+		if (previous[x] != NULL)
 		{
-			return symbolArray[hashIndex]->address;
+			int hashIndex = computeHash(previous[x]->id, symbols->slotCount);
+			while (symbols->slots[hashIndex] != NULL)
+			{
+				hashIndex = (hashIndex + 1) & (symbols->slotCount - 1);
+			}
+			symbols->slots[hashIndex] = previous[x];
 		}
-		hashIndex++;
 	}
-	displayError(UNKNOWN_SYMBOL, string);
-	exit(-1);
+	free(previous);
 }
 
-// Do no modify any part of this function
-// Set each element of the Symbol Table to NULL
-void initializeSymbolTable(symbol* symbolTable[])
+// Empties the Symbol Table; its slots are allocated when the first symbol is added
+void initializeSymbolTable(symbolTable* symbols)
 {
-	for (int x = 0; x < SYMBOL_TABLE_SIZE; x++)
-	{
-		symbolTable[x] = NULL;
-	}
+	symbols->slots = NULL;
+	symbols->count = 0;
+	symbols->slotCount = 0;
 }
 
-// Do no modify any part of this function
 // Add a symbol to an empty location in the Symbol Table
-void insertSymbol(symbol* symbolTable[], char symbolName[], int symbolAddress)
+void insertSymbol(symbolTable* symbols, int symbolId, int symbolAddress)
 {
-	int hashIndex = computeHash(symbolName);
+	int hashIndex;
 
-	for (int x = hashIndex; x < SYMBOL_TABLE_SIZE; x++)
+	// Keep the slots at most half full so probe sequences stay short
+	if (symbols->count * 2 >= symbols->slotCount)
 	{
-		if (symbolTable[x] == NULL)
-		{
-			symbolTable[x] = (symbol*)malloc(sizeof(symbol));
-			strcpy(symbolTable[x]->name, symbolName);
-			symbolTable[x]->address = symbolAddress;
+		growSymbolTable(symbols);
+	}
 
-			// printf("Added %s to Symbol Table at Index %2d\n", symbolName, x);
-			return;
-		}
-		else
+	hashIndex = computeHash(symbolId, symbols->slotCount);
+	while (symbols->slots[hashIndex] != NULL)
+	{
+		if (symbols->slots[hashIndex]->id == symbolId)
 		{
-			if (strcmp(symbolTable[x]->name, symbolName) == 0)
-			{
-				displayError(DUPLICATE, symbolTable[x]->name);
-				exit(-1);
-			}
+			displayError(DUPLICATE, symbols->slots[hashIndex]->name);
+			exit(-1);
 		}
+		hashIndex = (hashIndex + 1) & (symbols->slotCount - 1);
 	}
-}
 
-// Do no modify any part of this function
-// Tests whether the provided string contains an Indirect '@' or Immediate '#' symbol
-// Returns false if string contains an Indirect or Immediate symbol; otherwise, true
-bool isDirectAddressing(char* string)
-{
-	return !(string[0] == '#' || string[0] == '@');
+	symbols->slots[hashIndex] = (symbol*)malloc(sizeof(symbol));
+	symbols->slots[hashIndex]->id = symbolId;
+	symbols->slots[hashIndex]->name = getName(symbolId);
+	symbols->slots[hashIndex]->address = symbolAddress;
+	symbols->count++;
 }
@@ -13,14 +13,26 @@
 // Used to store data about a symbol
 typedef struct symbol
 {
-	char name[NAME_SIZE];
+	int id;        // Interned name ID
+	char* name;    // Interned name, which is not limited to NAME_SIZE
 	int address;
 } symbol;
 
+// Used to store the symbols of a program by interned ID
+// The slots double and every symbol is placed again once they are half full, so there is no limit on the
+// number of labels
+typedef struct symbolTable
+{
+	symbol** slots;    // Open-addressing table; NULL when empty
+	int count;
+	int slotCount;     // Power of two; 0 until the first symbol is added
+} symbolTable;
+
 // Pass 1 functions
-void displaySymbolTable(struct symbol* symbolTable[]);
-void initializeSymbolTable(struct symbol* symbolTable[]);
-void insertSymbol(struct symbol* symbolTable[], char symbolName[], int symbolAddress);
+void freeSymbolTable(symbolTable* symbols);
+void initializeSymbolTable(symbolTable* symbols);
+void insertSymbol(symbolTable* symbols, int symbolId, int symbolAddress);
 
 // Pass 2 functions
-int getSymbolAddress(struct symbol* symbolArray[], char* string);
\ No newline at end of file
+symbol* findSymbol(symbolTable* symbols, int symbolId);
+int getSymbolAddress(symbolTable* symbols, int symbolId);
\ No newline at end of file
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Runs each fixture in tests/cases and compares the files it produces with those in its expected directory
+#
+# A fixture is a directory holding its sources, a run script and an expected directory. The run script is
+# executed in a copy of the fixture with SIC_XE set to the assembler, and its standard output and exit status
+# are kept as the files stdout and status beside the files the assembler writes. Each file of the expected
+# directory must then match the file of the same name byte for byte.
+#
+# Usage: tests/run.sh [--update] [assembler]
+#   --update     Replace the expected files with the files the fixtures produce
+#   assembler    Path of the assembler to test; ./SIC_XE by default
+
+update=0
+if [ "$1" = "--update" ]; then
+	update=1
+	shift
+fi
+
+assembler=${1:-./SIC_XE}
+case "$assembler" in
+	/*) ;;
+	*) assembler="$(pwd)/$assembler" ;;
+esac
+if [ ! -x "$assembler" ]; then
+	echo "Assembler not found: $assembler" >&2
+	exit 2
+fi
+
+cases="$(cd "$(dirname "$0")/cases" && pwd)"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+failed=0
+
+for fixture in "$cases"/*/; do
+	name="$(basename "$fixture")"
+	rm -rf "$work/$name"
+	cp -R "$fixture" "$work/$name"
+	rm -rf "$work/$name/expected"
+
+	(cd "$work/$name" && SIC_XE="$assembler" sh ./run > stdout 2> stderr; echo $? > status)
+
+	result=pass
+	for expected in "$fixture"expected/*; do
+		file="$(basename "$expected")"
+		if [ $update -eq 1 ]; then
+			cp "$work/$name/$file" "$expected"
+		elif ! cmp -s "$expected" "$work/$name/$file"; then
+			echo "$name: $file differs"
+			diff "$expected" "$work/$name/$file" | head -20
+			result=fail
+		fi
+	done
+
+	if [ $result = fail ]; then
+		failed=$((failed + 1))
+		sed 's/^/    /' "$work/$name/stderr"
+	fi
+	echo "$result $name"
+done
+
+if [ $failed -ne 0 ]; then
+	echo "$failed fixture(s) failed"
+	exit 1
+fi
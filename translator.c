@@ -0,0 +1,670 @@
+#include "assembler.h"
+
+#define ADDRESS_MASK 0xFFFFF
+#define FIX_OPCODE 0xC4
+#define IMAGE_BYTES_PER_LINE 16
+#define J_OPCODE 0x3C
+#define JEQ_OPCODE 0x30
+#define JGT_OPCODE 0x34
+#define JLT_OPCODE 0x38
+#define JSUB_OPCODE 0x48
+#define NI_IMMEDIATE 1
+#define NI_INDIRECT 2
+#define NI_MASK 0x03
+#define NI_SIC 0
+#define REGISTER_LOCAL_COUNT 6
+#define RSUB_OPCODE 0x4C
+#define SIC_ADDRESS_MASK 0x7FFF
+
+// Kinds of operand a Format 3/4 statement is written with
+enum statementOperand { WORD_OPERAND, BYTE_OPERAND, STORE_ADDRESS };
+
+// Used to translate a Format 3/4 instruction other than a jump into one C statement
+typedef struct statementEntry {
+	int value;
+	int operand;
+	char* statement;         // printf format of the statement, given the operand
+} statementEntry;
+
+void addLeader(translation* code, int address);
+int decodeTarget(memoryImage* image, int address, targetAddress* target);
+void discoverBlocks(translation* code, decodeEntry table[], memoryImage* image);
+bool isJumpOpcode(int value);
+bool isTranslated(translation* code, int address);
+void writeBlocks(FILE* file, translation* code, decodeEntry table[], memoryImage* image);
+void writeImage(FILE* file, memoryImage* image);
+bool writeInstruction(FILE* file, translation* code, decodeEntry* entry, memoryImage* image, int address);
+void writeJump(FILE* file, translation* code, int address, char* target, bool known, int knownAddress, char* indent);
+bool writeRegisterInstruction(FILE* file, decodeEntry* entry, memoryImage* image, int address);
+
+// Names of the locals that hold registers 0 to 5 in the translated program
+char* registerLocals[REGISTER_LOCAL_COUNT] = { "A", "X", "L", "B", "S", "T" };
+
+// Format 3/4 instructions translated into a single statement; the rest fall back to the interpreter
+statementEntry statements[] = {
+	{ 0x18, WORD_OPERAND, "A = (A + %s) & WORD_MASK;" },
+	{ 0x40, WORD_OPERAND, "A &= %s;" },
+	{ 0x28, WORD_OPERAND, "cc = compare(A, %s);" },
+	{ 0x24, WORD_OPERAND, "A = divide(A, %s);" },
+	{ 0x00, WORD_OPERAND, "A = %s;" },
+	{ 0x68, WORD_OPERAND, "B = %s;" },
+	{ 0x50, BYTE_OPERAND, "A = (A & 0xFFFF00) | %s;" },
+	{ 0x08, WORD_OPERAND, "L = %s;" },
+	{ 0x6C, WORD_OPERAND, "S = %s;" },
+	{ 0x74, WORD_OPERAND, "T = %s;" },
+	{ 0x04, WORD_OPERAND, "X = %s;" },
+	{ 0x20, WORD_OPERAND, "A = multiply(A, %s);" },
+	{ 0x44, WORD_OPERAND, "A |= %s;" },
+	{ 0xD8, BYTE_OPERAND, "A = (A & 0xFFFF00) | readDevice(%s);" },
+	{ 0x0C, STORE_ADDRESS, "writeWord(%s, A);" },
+	{ 0x78, STORE_ADDRESS, "writeWord(%s, B);" },
+	{ 0x54, STORE_ADDRESS, "writeByte(%s, A);" },
+	{ 0x14, STORE_ADDRESS, "writeWord(%s, L);" },
+	{ 0x7C, STORE_ADDRESS, "writeWord(%s, S);" },
+	{ 0xE8, STORE_ADDRESS, "writeWord(%s, cc);" },
+	{ 0x84, STORE_ADDRESS, "writeWord(%s, T);" },
+	{ 0x10, STORE_ADDRESS, "writeWord(%s, X);" },
+	{ 0x1C, WORD_OPERAND, "A = (A - %s) & WORD_MASK;" },
+	{ 0xE0, BYTE_OPERAND, "cc = testDevice(%s);" },
+	{ 0x2C, WORD_OPERAND, "X = (X + 1) & WORD_MASK; cc = compare(X, %s);" },
+	{ 0xDC, BYTE_OPERAND, "writeDevice(%s, A);" },
+	{ -1, 0, NULL }
+};
+
+// Runtime of the translated program: memory, the instruction helpers shared with the translated
+// blocks, and the interpreter that runs whatever was not translated or has been overwritten
+const char* runtime =
+	"#include <stdbool.h>\n"
+	"#include <stdio.h>\n"
+	"#include <stdlib.h>\n"
+	"#include <string.h>\n"
+	"\n"
+	"#define ADDRESS_MASK 0xFFFFF\n"
+	"#define RETURN_ADDRESS 0x100000\n"
+	"#define WORD_MASK 0xFFFFFF\n"
+	"\n"
+	"#define LOAD_REGISTERS A = m.A, X = m.X, L = m.L, B = m.B, S = m.S, T = m.T, F = m.F, pc = m.pc, cc = m.cc\n"
+	"#define SAVE_REGISTERS m.A = A, m.X = X, m.L = L, m.B = B, m.S = S, m.T = T, m.F = F, m.pc = pc, m.cc = cc\n"
+	"\n"
+	"// Used to hand the registers to the interpreter\n"
+	"typedef struct machine {\n"
+	"\tint A, X, L, B, S, T, pc, cc;\n"
+	"\tdouble F;\n"
+	"} machine;\n"
+	"\n"
+	"static unsigned char memory[ADDRESS_MASK + 4];\n"
+	"static unsigned char code[ADDRESS_MASK + 4];  // 1 for each byte of a translated instruction\n"
+	"static bool modified;                         // Set once a store overwrites a translated instruction\n"
+	"\n"
+	"static int signExtend(int value) { return (value ^ 0x800000) - 0x800000; }\n"
+	"static int compare(int first, int second) { return (signExtend(first) > signExtend(second)) - (signExtend(first) < signExtend(second)); }\n"
+	"static int multiply(int first, int second) { return (int)((long long)signExtend(first) * signExtend(second)) & WORD_MASK; }\n"
+	"static int readByte(int address) { return memory[address & ADDRESS_MASK]; }\n"
+	"static int readWord(int address) { address &= ADDRESS_MASK; return memory[address] << 16 | memory[address + 1] << 8 | memory[address + 2]; }\n"
+	"static int readDevice(int device) { int c = getchar(); (void)device; return c == EOF ? 0 : c; }\n"
+	"static int shiftLeft(int value, int count) { return ((value << count) | (value >> (24 - count))) & WORD_MASK; }\n"
+	"static int shiftRight(int value, int count) { return (signExtend(value) >> count) & WORD_MASK; }\n"
+	"static int testDevice(int device) { (void)device; return -1; }\n"
+	"static void writeByte(int address, int value) { address &= ADDRESS_MASK; memory[address] = value; modified |= code[address]; }\n"
+	"static void writeDevice(int device, int value) { (void)device; putchar(value & 0xFF); }\n"
+	"static void writeWord(int address, int value) { writeByte(address, value >> 16); writeByte(address + 1, value >> 8); writeByte(address + 2, value); }\n"
+	"\n"
+	"// Reports an instruction the runtime does not support and stops the program\n"
+	"static void unsupported(int address)\n"
+	"{\n"
+	"\tfprintf(stderr, \"Unsupported instruction %02X at %X\\n\", memory[address], address);\n"
+	"\texit(1);\n"
+	"}\n"
+	"\n"
+	"// Divides two signed words, stopping the program on division by zero\n"
+	"static int divide(int first, int second)\n"
+	"{\n"
+	"\tif (signExtend(second) == 0)\n"
+	"\t{\n"
+	"\t\tfprintf(stderr, \"Division by zero\\n\");\n"
+	"\t\texit(1);\n"
+	"\t}\n"
+	"\treturn (signExtend(first) / signExtend(second)) & WORD_MASK;\n"
+	"}\n"
+	"\n"
+	"// Executes the instruction at the program counter\n"
+	"// Returns false once the program halts by jumping to itself\n"
+	"static bool step(machine* m)\n"
+	"{\n"
+	"\tint* registers[] = { &m->A, &m->X, &m->L, &m->B, &m->S, &m->T };\n"
+	"\tint address = m->pc, opcode = memory[address] & 0xFC, ni = memory[address] & 3;\n"
+	"\tint first = memory[address + 1] >> 4, second = memory[address + 1] & 0x0F, flags = first;\n"
+	"\tint length = 3, target, value;\n"
+	"\n"
+	"\tif (opcode == 0xC4)\n"
+	"\t{\n"
+	"\t\tm->A = (int)m->F & WORD_MASK;\n"
+	"\t\tm->pc += 1;\n"
+	"\t\treturn true;\n"
+	"\t}\n"
+	"\tif (opcode >= 0x90 && opcode <= 0xB8 && opcode != 0xB0)\n"
+	"\t{\n"
+	"\t\tbool single = opcode == 0xB4 || opcode == 0xB8 || opcode == 0xA4 || opcode == 0xA8;\n"
+	"\t\tif (first >= 6 || (!single && second >= 6))\n"
+	"\t\t{\n"
+	"\t\t\tunsupported(address);\n"
+	"\t\t}\n"
+	"\t\tint* r1 = registers[first];\n"
+	"\t\tint* r2 = single ? NULL : registers[second];\n"
+	"\t\tswitch (opcode)\n"
+	"\t\t{\n"
+	"\t\tcase 0x90: *r2 = (*r2 + *r1) & WORD_MASK; break;\n"
+	"\t\tcase 0x94: *r2 = (*r2 - *r1) & WORD_MASK; break;\n"
+	"\t\tcase 0x98: *r2 = multiply(*r2, *r1); break;\n"
+	"\t\tcase 0x9C: *r2 = divide(*r2, *r1); break;\n"
+	"\t\tcase 0xA0: m->cc = compare(*r1, *r2); break;\n"
+	"\t\tcase 0xA4: *r1 = shiftLeft(*r1, second + 1); break;\n"
+	"\t\tcase 0xA8: *r1 = shiftRight(*r1, second + 1); break;\n"
+	"\t\tcase 0xAC: *r2 = *r1; break;\n"
+	"\t\tcase 0xB4: *r1 = 0; break;\n"
+	"\t\tcase 0xB8: m->X = (m->X + 1) & WORD_MASK; m->cc = compare(m->X, *r1); break;\n"
+	"\t\t}\n"
+	"\t\tm->pc += 2;\n"
+	"\t\treturn true;\n"
+	"\t}\n"
+	"\tif (opcode == 0xB0 || opcode >= 0xF0)\n"
+	"\t{\n"
+	"\t\tunsupported(address);\n"
+	"\t}\n"
+	"\n"
+	"\tif (ni == 0)\n"
+	"\t{\n"
+	"\t\ttarget = ((memory[address + 1] << 8) | memory[address + 2]) & 0x7FFF;\n"
+	"\t\tflags &= 0x08;\n"
+	"\t}\n"
+	"\telse\n"
+	"\t{\n"
+	"\t\tint displacement = ((memory[address + 1] & 0x0F) << 8) | memory[address + 2];\n"
+	"\t\tif (flags & 0x01)\n"
+	"\t\t{\n"
+	"\t\t\tlength = 4;\n"
+	"\t\t\ttarget = (displacement << 8) | memory[address + 3];\n"
+	"\t\t}\n"
+	"\t\telse if (flags & 0x02)\n"
+	"\t\t{\n"
+	"\t\t\ttarget = address + 3 + (displacement ^ 0x800) - 0x800;\n"
+	"\t\t}\n"
+	"\t\telse\n"
+	"\t\t{\n"
+	"\t\t\ttarget = (flags & 0x04) ? m->B + displacement : displacement;\n"
+	"\t\t}\n"
+	"\t}\n"
+	"\ttarget = (target + ((flags & 0x08) ? m->X : 0)) & ADDRESS_MASK;\n"
+	"\tif (ni == 2)\n"
+	"\t{\n"
+	"\t\ttarget = readWord(target);\n"
+	"\t}\n"
+	"\tvalue = ni == 1 ? target : readWord(target);\n"
+	"\n"
+	"\tm->pc = address + length;\n"
+	"\tswitch (opcode)\n"
+	"\t{\n"
+	"\tcase 0x18: m->A = (m->A + value) & WORD_MASK; break;\n"
+	"\tcase 0x40: m->A &= value; break;\n"
+	"\tcase 0x28: m->cc = compare(m->A, value); break;\n"
+	"\tcase 0x24: m->A = divide(m->A, value); break;\n"
+	"\tcase 0x3C: m->pc = target; break;\n"
+	"\tcase 0x30: m->pc = m->cc == 0 ? target : m->pc; break;\n"
+	"\tcase 0x34: m->pc = m->cc > 0 ? target : m->pc; break;\n"
+	"\tcase 0x38: m->pc = m->cc < 0 ? target : m->pc; break;\n"
+	"\tcase 0x48: m->L = m->pc; m->pc = target; break;\n"
+	"\tcase 0x00: m->A = value; break;\n"
+	"\tcase 0x68: m->B = value; break;\n"
+	"\tcase 0x50: m->A = (m->A & 0xFFFF00) | (ni == 1 ? target & 0xFF : readByte(target)); break;\n"
+	"\tcase 0x08: m->L = value; break;\n"
+	"\tcase 0x6C: m->S = value; break;\n"
+	"\tcase 0x74: m->T = value; break;\n"
+	"\tcase 0x04: m->X = value; break;\n"
+	"\tcase 0x20: m->A = multiply(m->A, value); break;\n"
+	"\tcase 0x44: m->A |= value; break;\n"
+	"\tcase 0xD8: m->A = (m->A & 0xFFFF00) | readDevice(ni == 1 ? target & 0xFF : readByte(target)); break;\n"
+	"\tcase 0x4C: m->pc = m->L; break;\n"
+	"\tcase 0x0C: writeWord(target, m->A); break;\n"
+	"\tcase 0x78: writeWord(target, m->B); break;\n"
+	"\tcase 0x54: writeByte(target, m->A); break;\n"
+	"\tcase 0x14: writeWord(target, m->L); break;\n"
+	"\tcase 0x7C: writeWord(target, m->S); break;\n"
+	"\tcase 0xE8: writeWord(target, m->cc); break;\n"
+	"\tcase 0x84: writeWord(target, m->T); break;\n"
+	"\tcase 0x10: writeWord(target, m->X); break;\n"
+	"\tcase 0x1C: m->A = (m->A - value) & WORD_MASK; break;\n"
+	"\tcase 0xE0: m->cc = testDevice(ni == 1 ? target & 0xFF : readByte(target)); break;\n"
+	"\tcase 0x2C: m->X = (m->X + 1) & WORD_MASK; m->cc = compare(m->X, value); break;\n"
+	"\tcase 0xDC: writeDevice(ni == 1 ? target & 0xFF : readByte(target), m->A); break;\n"
+	"\tdefault: unsupported(address);\n"
+	"\t}\n"
+	"\treturn m->pc != address;\n"
+	"}\n";
+
+// Marks the address as the start of a basic block and queues it to be decoded
+void addLeader(translation* code, int address)
+{
+	if (address >= 0 && address < MEMORY_SIZE && !code->leaders[address])
+	{
+		code->leaders[address] = true;
+		code->pending[code->pendingCount++] = address;
+	}
+}
+
+// Decodes the target address of the Format 3/4 instruction at the provided address
+// Returns the length of the instruction; otherwise, 0 (the bytes are not a valid instruction)
+int decodeTarget(memoryImage* image, int address, targetAddress* target)
+{
+	unsigned char* bytes = &image->bytes[address];
+	int flags = bytes[1] >> 4;
+	char* base = "";
+
+	if (!isLoaded(image, address, 3))
+	{
+		return 0;
+	}
+	target->ni = bytes[0] & NI_MASK;
+	target->length = 3;
+
+	if (target->ni == NI_SIC)
+	{
+		target->address = ((bytes[1] << 8) | bytes[2]) & SIC_ADDRESS_MASK;
+		flags &= FLAG_X;
+	}
+	else if (flags & FLAG_E)
+	{
+		if (!isLoaded(image, address, 4) || (flags & (FLAG_B | FLAG_P)))
+		{
+			return 0;
+		}
+		target->length = 4;
+		target->address = ((bytes[1] & 0x0F) << 16) | (bytes[2] << 8) | bytes[3];
+	}
+	else
+	{
+		int displacement = ((bytes[1] & 0x0F) << 8) | bytes[2];
+		if ((flags & FLAG_B) && (flags & FLAG_P))
+		{
+			return 0;
+		}
+		else if (flags & FLAG_P)
+		{
+			// Sign-extend the 12-bit displacement
+			target->address = (address + 3 + (displacement ^ 0x800) - 0x800) & ADDRESS_MASK;
+		}
+		else
+		{
+			target->address = displacement;
+			base = (flags & FLAG_B) ? "B + " : "";
+		}
+	}
+
+	// A target relative to BASE or indexed by X is only known while the program runs
+	target->known = !(flags & (FLAG_B | FLAG_X));
+	if (target->known)
+	{
+		sprintf(target->expression, "0x%X", target->address);
+	}
+	else
+	{
+		sprintf(target->expression, "((%s0x%X%s) & ADDRESS_MASK)", base, target->address, (flags & FLAG_X) ? " + X" : "");
+	}
+	return target->length;
+}
+
+// Follows the control flow from the entry point, decoding every reachable instruction
+// Jump targets and the instructions after JSUB and conditional jumps start new basic blocks
+void discoverBlocks(translation* code, decodeEntry table[], memoryImage* image)
+{
+	addLeader(code, image->entry);
+	while (code->pendingCount > 0)
+	{
+		int address = code->pending[--code->pendingCount];
+
+		while (address >= image->start && address < image->end && code->lengths[address] == 0)
+		{
+			decodeEntry* entry = &table[image->bytes[address]];
+			targetAddress target;
+			int length;
+
+			if (entry->name == NULL || !image->loaded[address])
+			{
+				break;
+			}
+			if (entry->format == FORMAT_3)
+			{
+				length = decodeTarget(image, address, &target);
+			}
+			else
+			{
+				length = (entry->format == FORMAT_1 || isLoaded(image, address, 2)) ? entry->format : 0;
+			}
+			if (length == 0)
+			{
+				break;
+			}
+			code->lengths[address] = length;
+			code->instructionCount++;
+
+			if (entry->format == FORMAT_3 && (isJumpOpcode(entry->value) || entry->value == RSUB_OPCODE))
+			{
+				if (entry->value != RSUB_OPCODE && target.known && target.ni != NI_INDIRECT)
+				{
+					addLeader(code, target.address);
+				}
+				if (entry->value == J_OPCODE || entry->value == RSUB_OPCODE)
+				{
+					break;
+				}
+				addLeader(code, address + length);
+			}
+			address += length;
+		}
+
+		// Falling into an instruction that was already decoded continues in its block
+		if (address < MEMORY_SIZE && code->lengths[address] != 0)
+		{
+			code->leaders[address] = true;
+		}
+	}
+
+	for (int address = image->start; address < image->end; address++)
+	{
+		code->blockCount += isTranslated(code, address);
+	}
+}
+
+// Returns true if the opcode is J, JEQ, JGT, JLT or JSUB; otherwise, false
+bool isJumpOpcode(int value)
+{
+	return value == J_OPCODE || value == JEQ_OPCODE || value == JGT_OPCODE || value == JLT_OPCODE || value == JSUB_OPCODE;
+}
+
+// Returns true if a translated basic block starts at the address; otherwise, false
+bool isTranslated(translation* code, int address)
+{
+	return address >= 0 && address < MEMORY_SIZE && code->leaders[address] && code->lengths[address] != 0;
+}
+
+// Translates a .obj file or raw memory image into a C program that runs it natively
+// Basic blocks reachable through direct jumps become C code; indirect jumps, instructions the
+// translator does not handle and code the program overwrites are run by an interpreter instead
+void translateFile(char* filename, char* outputName)
+{
+	decodeEntry table[DECODE_TABLE_SIZE];
+	translation code = { NULL };
+	memoryImage image;
+	FILE* file;
+
+	loadMemoryImage(filename, &image);
+	buildDecodeTable(table);
+
+	code.lengths = (unsigned char*)calloc(MEMORY_SIZE, sizeof(unsigned char));
+	code.leaders = (bool*)calloc(MEMORY_SIZE, sizeof(bool));
+	code.pending = (int*)malloc(sizeof(int) * MEMORY_SIZE);
+	discoverBlocks(&code, table, &image);
+
+	if (!(file = fopen(outputName, "w")))
+	{
+		displayError(FILE_NOT_FOUND, outputName);
+		exit(-1);
+	}
+	fprintf(file, "// %s translated from %s\n", image.name, filename);
+	fprintf(file, "#define PROGRAM_START 0x%X\n#define PROGRAM_END 0x%X\n#define PROGRAM_ENTRY 0x%X\n\n", image.start, image.end, image.entry);
+	fputs(runtime, file);
+	writeImage(file, &image);
+	writeBlocks(file, &code, table, &image);
+	fclose(file);
+
+	printf("Translated %d instructions in %d basic blocks to %s.\n", code.instructionCount, code.blockCount, outputName);
+	free(code.lengths);
+	free(code.leaders);
+	free(code.pending);
+	freeMemoryImage(&image);
+}
+
+// Writes main: the translated basic blocks, entered through a dispatch on the program counter
+// that falls back to the interpreter for any address without a block
+void writeBlocks(FILE* file, translation* code, decodeEntry table[], memoryImage* image)
+{
+	fputs("\nint main(void)\n{\n", file);
+	fputs("\tint A = 0, X = 0, L = RETURN_ADDRESS, B = 0, S = 0, T = 0, pc = PROGRAM_ENTRY, cc = 0;\n", file);
+	fputs("\tdouble F = 0;\n\tmachine m;\n\n", file);
+	fputs("\tmemcpy(&memory[PROGRAM_START], image, sizeof(image));\n", file);
+	for (int address = image->start; address < image->end; address++)
+	{
+		if (isTranslated(code, address))
+		{
+			int end = address;
+			do
+			{
+				end += code->lengths[end];
+			} while (end < MEMORY_SIZE && code->lengths[end] != 0 && !code->leaders[end]);
+			fprintf(file, "\tmemset(&code[0x%X], 1, %d);\n", address, end - address);
+		}
+	}
+	fputs("\tgoto dispatch;\n", file);
+
+	for (int address = image->start; address < image->end; address++)
+	{
+		if (!isTranslated(code, address))
+		{
+			continue;
+		}
+
+		int next = address;
+		fprintf(file, "\nblock_%X:\n", address);
+		do
+		{
+			if (!writeInstruction(file, code, &table[image->bytes[next]], image, next))
+			{
+				break;
+			}
+			next += code->lengths[next];
+			if (isTranslated(code, next))
+			{
+				fprintf(file, "\tgoto block_%X;\n", next);
+			}
+			else if (code->lengths[next] == 0)
+			{
+				fprintf(file, "\tpc = 0x%X;\n\tgoto dispatch;\n", next);
+			}
+		} while (next < MEMORY_SIZE && code->lengths[next] != 0 && !code->leaders[next]);
+	}
+
+	fputs("\ndispatch:\n\twhile (pc >= PROGRAM_START && pc < PROGRAM_END)\n\t{\n", file);
+	fputs("\t\tif (!modified)\n\t\t{\n\t\t\tswitch (pc)\n\t\t\t{\n", file);
+	for (int address = image->start; address < image->end; address++)
+	{
+		if (isTranslated(code, address))
+		{
+			fprintf(file, "\t\t\tcase 0x%X: goto block_%X;\n", address, address);
+		}
+	}
+	fputs("\t\t\t}\n\t\t}\n", file);
+	fputs("\t\tSAVE_REGISTERS;\n\t\tbool running = step(&m);\n\t\tLOAD_REGISTERS;\n", file);
+	fputs("\t\tif (!running)\n\t\t{\n\t\t\tgoto halt;\n\t\t}\n\t}\n", file);
+	fputs("\nhalt:\n\tfflush(stdout);\n", file);
+	fputs("\tfprintf(stderr, \"A=%06X X=%06X L=%06X B=%06X S=%06X T=%06X PC=%06X\\n\", A, X, L, B, S, T, pc);\n", file);
+	fputs("\treturn 0;\n}\n", file);
+}
+
+// Writes the bytes of the program from its start to its end, with zeros for reserved areas
+void writeImage(FILE* file, memoryImage* image)
+{
+	fprintf(file, "\nstatic const unsigned char image[0x%X] = {", image->end - image->start);
+	for (int address = image->start; address < image->end; address++)
+	{
+		if ((address - image->start) % IMAGE_BYTES_PER_LINE == 0)
+		{
+			fputs("\n\t", file);
+		}
+		fprintf(file, "0x%02X,", image->bytes[address]);
+	}
+	fputs("\n};\n", file);
+}
+
+// Writes the C statements of the instruction at the provided address
+// Returns false if the instruction ends its basic block; otherwise, true
+bool writeInstruction(FILE* file, translation* code, decodeEntry* entry, memoryImage* image, int address)
+{
+	char operand[TARGET_EXPRESSION_SIZE * 2];
+	targetAddress target;
+	int next = address + code->lengths[address];
+
+	fprintf(file, "\t// %X %s%s\n", address, code->lengths[address] == 4 ? "+" : "", entry->name);
+	if (entry->format != FORMAT_3)
+	{
+		if (writeRegisterInstruction(file, entry, image, address))
+		{
+			return true;
+		}
+		fprintf(file, "\tpc = 0x%X;\n\tgoto dispatch;\n", address);
+		return false;
+	}
+
+	decodeTarget(image, address, &target);
+	if (target.ni == NI_INDIRECT)
+	{
+		sprintf(operand, "readWord(%s)", target.expression);
+	}
+	else
+	{
+		strcpy(operand, target.expression);
+	}
+
+	if (entry->value == RSUB_OPCODE)
+	{
+		fputs("\tpc = L;\n\tgoto dispatch;\n", file);
+		return false;
+	}
+	if (isJumpOpcode(entry->value))
+	{
+		bool known = target.known && target.ni != NI_INDIRECT;
+		if (entry->value == J_OPCODE || entry->value == JSUB_OPCODE)
+		{
+			if (entry->value == JSUB_OPCODE)
+			{
+				fprintf(file, "\tL = 0x%X;\n", next);
+			}
+			writeJump(file, code, address, operand, known, target.address, "\t");
+			return false;
+		}
+		fprintf(file, "\tif (cc %s 0)\n\t{\n", entry->value == JEQ_OPCODE ? "==" : entry->value == JGT_OPCODE ? ">" : "<");
+		writeJump(file, code, address, operand, known, target.address, "\t\t");
+		fputs("\t}\n", file);
+		return true;
+	}
+
+	for (statementEntry* statement = statements; statement->statement != NULL; statement++)
+	{
+		if (statement->value != entry->value)
+		{
+			continue;
+		}
+
+		char value[TARGET_EXPRESSION_SIZE * 3];
+		if (statement->operand == STORE_ADDRESS)
+		{
+			strcpy(value, operand);
+		}
+		else if (target.ni == NI_IMMEDIATE)
+		{
+			sprintf(value, statement->operand == BYTE_OPERAND ? "(%s & 0xFF)" : "%s", operand);
+		}
+		else
+		{
+			sprintf(value, statement->operand == BYTE_OPERAND ? "readByte(%s)" : "readWord(%s)", operand);
+		}
+
+		fputc('\t', file);
+		fprintf(file, statement->statement, value);
+		fputc('\n', file);
+
+		// A store into a translated instruction hands the rest of the run to the interpreter
+		if (statement->operand == STORE_ADDRESS)
+		{
+			fprintf(file, "\tif (modified)\n\t{\n\t\tpc = 0x%X;\n\t\tgoto dispatch;\n\t}\n", next);
+		}
+		return true;
+	}
+
+	fprintf(file, "\tpc = 0x%X;\n\tgoto dispatch;\n", address);
+	return false;
+}
+
+// Writes a jump to the target: straight to its block when the target is known and translated,
+// to the program end when the jump targets itself, and through the dispatch otherwise
+void writeJump(FILE* file, translation* code, int address, char* target, bool known, int knownAddress, char* indent)
+{
+	if (known && knownAddress == address)
+	{
+		fprintf(file, "%spc = 0x%X;\n%sgoto halt;\n", indent, address, indent);
+	}
+	else if (known && isTranslated(code, knownAddress))
+	{
+		fprintf(file, "%sgoto block_%X;\n", indent, knownAddress);
+	}
+	else
+	{
+		fprintf(file, "%spc = %s;\n%sgoto dispatch;\n", indent, target, indent);
+	}
+}
+
+// Writes the C statement of a Format 1/2 instruction
+// Returns false if the runtime has no statement for the instruction; otherwise, true
+bool writeRegisterInstruction(FILE* file, decodeEntry* entry, memoryImage* image, int address)
+{
+	int first = image->bytes[address + 1] >> 4, second = image->bytes[address + 1] & 0x0F;
+	char *r1, *r2;
+
+	if (entry->value == FIX_OPCODE)
+	{
+		fputs("\tA = (int)F & WORD_MASK;\n", file);
+		return true;
+	}
+	if (entry->format != FORMAT_2 || entry->operands == INTERRUPT_NUMBER || first >= REGISTER_LOCAL_COUNT ||
+		(entry->operands == REGISTER_PAIR && second >= REGISTER_LOCAL_COUNT))
+	{
+		return false;
+	}
+	r1 = registerLocals[first];
+	r2 = registerLocals[second < REGISTER_LOCAL_COUNT ? second : 0];
+
+	switch (entry->value)
+	{
+	case 0x90:
+		fprintf(file, "\t%s = (%s + %s) & WORD_MASK;\n", r2, r2, r1);
+		break;
+	case 0x94:
+		fprintf(file, "\t%s = (%s - %s) & WORD_MASK;\n", r2, r2, r1);
+		break;
+	case 0x98:
+		fprintf(file, "\t%s = multiply(%s, %s);\n", r2, r2, r1);
+		break;
+	case 0x9C:
+		fprintf(file, "\t%s = divide(%s, %s);\n", r2, r2, r1);
+		break;
+	case 0xA0:
+		fprintf(file, "\tcc = compare(%s, %s);\n", r1, r2);
+		break;
+	case 0xA4:
+		fprintf(file, "\t%s = shiftLeft(%s, %d);\n", r1, r1, second + 1);
+		break;
+	case 0xA8:
+		fprintf(file, "\t%s = shiftRight(%s, %d);\n", r1, r1, second + 1);
+		break;
+	case 0xAC:
+		fprintf(file, "\t%s = %s;\n", r2, r1);
+		break;
+	case 0xB4:
+		fprintf(file, "\t%s = 0;\n", r1);
+		break;
+	case 0xB8:
+		fprintf(file, "\tX = (X + 1) & WORD_MASK;\n\tcc = compare(X, %s);\n", r1);
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
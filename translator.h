@@ -0,0 +1,24 @@
+#pragma once
+
+#define TARGET_EXPRESSION_SIZE 64
+
+// Used to record the instructions reachable from the entry point and where each basic block starts
+typedef struct translation {
+	unsigned char* lengths;  // Length of the instruction decoded at each address; 0 elsewhere
+	bool* leaders;           // Addresses that start a basic block
+	int* pending;            // Leaders whose instructions have not been decoded yet
+	int pendingCount;
+	int instructionCount;
+	int blockCount;          // Leaders that start with a decoded instruction
+} translation;
+
+// Used to describe the target address of a Format 3/4 instruction as a C expression
+typedef struct targetAddress {
+	char expression[TARGET_EXPRESSION_SIZE];
+	int address;             // The target when it does not depend on a register
+	bool known;
+	int ni;
+	int length;              // Length of the instruction: 3 or 4
+} targetAddress;
+
+void translateFile(char* filename, char* outputName);
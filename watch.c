@@ -0,0 +1,110 @@
+#include "assembler.h"
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+bool readChanges(watchList* watches);
+
+// Starts watching the provided file, unless it is already watched
+void addWatch(watchList* watches, char* filename)
+{
+	char directory[PATH_MAX];
+	char* slash = strrchr(filename, '/');
+	char* name = slash ? slash + 1 : filename;
+	int directoryWatch;
+
+	if (slash != NULL)
+	{
+		snprintf(directory, sizeof(directory), "%.*s", (int)(slash - filename), filename);
+	}
+	else
+	{
+		strcpy(directory, ".");
+	}
+
+	// inotify returns the same watch descriptor for a directory that is already watched
+	directoryWatch = inotify_add_watch(watches->descriptor, slash == filename ? "/" : directory, WATCH_EVENTS);
+	if (directoryWatch < 0)
+	{
+		displayError(FILE_NOT_FOUND, filename);
+		exit(-1);
+	}
+
+	for (int x = 0; x < watches->count; x++)
+	{
+		if (watches->directories[x] == directoryWatch && strcmp(watches->names[x], name) == 0)
+		{
+			return;
+		}
+	}
+	if (watches->count == MAX_WATCHED_FILES)
+	{
+		return;
+	}
+	watches->directories[watches->count] = directoryWatch;
+	watches->names[watches->count++] = strdup(name);
+}
+
+// Stops watching every file
+void closeWatch(watchList* watches)
+{
+	for (int x = 0; x < watches->count; x++)
+	{
+		free(watches->names[x]);
+	}
+	close(watches->descriptor);
+	watches->count = 0;
+}
+
+// Creates the inotify instance used to watch files
+void initializeWatch(watchList* watches)
+{
+	watches->count = 0;
+	watches->descriptor = inotify_init1(IN_CLOEXEC);
+	if (watches->descriptor < 0)
+	{
+		displayError(FILE_NOT_FOUND, "inotify");
+		exit(-1);
+	}
+}
+
+// Reads the pending inotify events
+// Returns true if any of them is for a watched file; otherwise, false
+bool readChanges(watchList* watches)
+{
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t length = read(watches->descriptor, buffer, sizeof(buffer));
+	bool changed = false;
+
+	for (char* position = buffer; length > 0 && position < buffer + length; )
+	{
+		struct inotify_event* event = (struct inotify_event*)position;
+		for (int x = 0; x < watches->count && event->len > 0; x++)
+		{
+			if (watches->directories[x] == event->wd && strcmp(watches->names[x], event->name) == 0)
+			{
+				changed = true;
+			}
+		}
+		position += sizeof(struct inotify_event) + event->len;
+	}
+	return changed;
+}
+
+// Blocks until a watched file has been written or replaced
+// Events that are already queued, such as an editor writing a backup first, count as one change
+void waitForChange(watchList* watches)
+{
+	struct pollfd events = { watches->descriptor, POLLIN, 0 };
+
+	while (!readChanges(watches))
+	{
+	}
+	while (poll(&events, 1, 0) > 0)
+	{
+		readChanges(watches);
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#define MAX_WATCHED_FILES 64
+
+// Used to watch the source file and the files it pulls in for changes
+// Each file is watched through its directory so editors that save by rename are noticed
+typedef struct watchList {
+	int descriptor;                          // inotify instance
+	int directories[MAX_WATCHED_FILES];      // Watch descriptor of the directory of each file
+	char* names[MAX_WATCHED_FILES];          // Name of each file within its directory
+	int count;
+} watchList;
+
+void addWatch(watchList* watches, char* filename);
+void closeWatch(watchList* watches);
+void initializeWatch(watchList* watches);
+void waitForChange(watchList* watches);